@@ -24,6 +24,7 @@
 * Website: https://covscript.org.cn
 */
 #include <covscript/core/core.hpp>
+#include <map>
 
 #ifdef COVSCRIPT_PLATFORM_WIN32
 
@@ -34,9 +35,14 @@
 #else
 
 #include <sys/types.h>
+#include <sys/mman.h>
 #include <unistd.h>
 #include <pwd.h>
 
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
 #endif
 
 #ifdef _MSC_VER
@@ -50,7 +56,7 @@
 #include <Dbghelp.h>
 #pragma comment(lib, "DbgHelp")
 namespace cs_impl {
-	std::string cxx_demangle(const char* name)
+	static std::string demangle(const char* name)
 	{
 		char buffer[1024];
 		DWORD length = UnDecorateSymbolName(name, buffer, sizeof(buffer), 0);
@@ -63,24 +69,193 @@ namespace cs_impl {
 #elif defined __GNUC__
 
 #include <cxxabi.h>
+#include <cstdlib>
 
 namespace cs_impl {
-	std::string cxx_demangle(const char *name)
+	static std::string demangle(const char *name)
 	{
-		char buffer[1024] = {0};
-		size_t size = sizeof(buffer);
 		int status;
-		char *ret = abi::__cxa_demangle(name, buffer, &size, &status);
-		if (ret != nullptr)
-			return std::string(ret);
+		char *ret = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+		if (ret != nullptr) {
+			std::string str(ret);
+			std::free(ret);
+			return str;
+		}
 		else
 			return name;
 	}
 }
+#else
+namespace cs_impl {
+	static std::string demangle(const char *name)
+	{
+		return name;
+	}
+}
 #endif
 
 namespace cs_impl {
-	cs::allocator_type<any::proxy, default_allocate_buffer_size*default_allocate_buffer_multiplier, default_allocator_provider> any::allocator;
+	/*
+	* Demangled names are cached by content and never released, so references to them stay valid.
+	* Names are looked up by address first, the content is still checked as the address of a name
+	* may be reused after its module is unloaded.
+	*/
+	struct demangle_cache {
+		std::mutex lock;
+		cs::map_t<std::string, std::string> names;
+		cs::map_t<const char *, const std::pair<const std::string, std::string> *> addresses;
+	};
+
+	const std::string &cxx_demangle(const char *name)
+	{
+		static demangle_cache *cache = new demangle_cache;
+		std::lock_guard<std::mutex> guard(cache->lock);
+		auto addr = cache->addresses.find(name);
+		if (addr != cache->addresses.end() && addr->second->first == name)
+			return addr->second->second;
+		auto it = cache->names.find(name);
+		if (it == cache->names.end())
+			it = cache->names.emplace(name, demangle(name)).first;
+		cache->addresses[name] = &*it;
+		return it->second;
+	}
+}
+
+namespace cs_impl {
+	static std::mutex type_id_lock;
+	static type_id_slot *type_id_slots = nullptr;
+
+	std::size_t resolve_type_id(type_id_slot &slot, const std::type_info &info)
+	{
+		std::size_t id = cs::current_process->type_ids.get_id(info);
+		std::lock_guard<std::mutex> guard(type_id_lock);
+		if (slot.id.load(std::memory_order_relaxed) == 0) {
+			slot.next = type_id_slots;
+			type_id_slots = &slot;
+			slot.id.store(id, std::memory_order_relaxed);
+		}
+		return id;
+	}
+
+	void reset_type_ids()
+	{
+		std::lock_guard<std::mutex> guard(type_id_lock);
+		for (type_id_slot *slot = type_id_slots; slot != nullptr; slot = slot->next)
+			slot->id.store(0, std::memory_order_relaxed);
+		type_id_slots = nullptr;
+	}
+
+#ifdef COVSCRIPT_VAR_CYCLE_COLLECTOR
+	bool cycle_suspect(void *ptr) noexcept
+	{
+		return cs::current_process->var_cycles.suspect(ptr);
+	}
+
+	void cycle_forget(void *ptr) noexcept
+	{
+		cs::current_process->var_cycles.forget(ptr);
+	}
+
+	void cycle_allocated() noexcept
+	{
+		cs::current_process->var_cycles.allocated();
+	}
+#endif
+
+#ifdef COVSCRIPT_VAR_DEFERRED_RELEASE
+	bool defer_release(void *object, void (*release)(void *)) noexcept
+	{
+		cs::release_queue &queue = cs::current_process->var_release;
+		return queue.enabled() && queue.push(object, release);
+	}
+#endif
+
+#ifdef COVSCRIPT_VAR_STATISTICS
+	static std::mutex statistics_lock;
+	static statistics_slot *statistics_slots = nullptr;
+
+	statistics_counter &resolve_statistics(statistics_slot &slot, const char *name)
+	{
+		cs::statistics_registry *reg = cs::current_process->var_counters;
+		// Context of current module is not constructed yet
+		if (reg == nullptr)
+			reg = cs::statistics_registry::local();
+		statistics_counter &counter = reg->get(cxx_demangle(name));
+		std::lock_guard<std::mutex> guard(statistics_lock);
+		if (slot.counter.load(std::memory_order_relaxed) == nullptr) {
+			slot.next = statistics_slots;
+			statistics_slots = &slot;
+			slot.counter.store(&counter, std::memory_order_release);
+		}
+		return *slot.counter.load(std::memory_order_relaxed);
+	}
+
+	void reset_statistics()
+	{
+		std::lock_guard<std::mutex> guard(statistics_lock);
+		for (statistics_slot *slot = statistics_slots; slot != nullptr; slot = slot->next)
+			slot->counter.store(nullptr, std::memory_order_relaxed);
+		statistics_slots = nullptr;
+		cs::statistics_registry *local = cs::statistics_registry::local();
+		if (cs::current_process->var_counters != local)
+			cs::current_process->var_counters->merge(*local);
+	}
+#endif
+
+	constexpr std::intptr_t refcount_biased::merged_flag;
+	constexpr std::intptr_t refcount_biased::queued_flag;
+	constexpr std::intptr_t refcount_biased::count_unit;
+
+	struct biased_owner_guard final {
+		biased_owner *owner = nullptr;
+
+		~biased_owner_guard()
+		{
+			if (owner != nullptr)
+				owner->retire();
+		}
+	};
+
+	static std::mutex biased_owner_lock;
+
+	// Retired owners may still be referenced by variables, so the pool is never destroyed
+	static std::vector<biased_owner *> &biased_owner_pool()
+	{
+		static std::vector<biased_owner *> *pool = new std::vector<biased_owner *>;
+		return *pool;
+	}
+
+	biased_owner *biased_owner::create()
+	{
+		static thread_local biased_owner_guard guard;
+		if (guard.owner == nullptr) {
+			std::lock_guard<std::mutex> pool_guard(biased_owner_lock);
+			if (!biased_owner_pool().empty()) {
+				guard.owner = biased_owner_pool().back();
+				biased_owner_pool().pop_back();
+				std::lock_guard<std::mutex> owner_guard(guard.owner->m_lock);
+				guard.owner->m_alive = true;
+			}
+			else
+				guard.owner = new biased_owner;
+		}
+		return guard.owner;
+	}
+
+	void biased_owner::retire()
+	{
+		std::vector<entry> queue;
+		{
+			std::lock_guard<std::mutex> guard(m_lock);
+			m_alive = false;
+			m_pending = false;
+			std::swap(queue, m_queue);
+		}
+		release_all(queue);
+		std::lock_guard<std::mutex> pool_guard(biased_owner_lock);
+		biased_owner_pool().push_back(this);
+	}
+
 }
 
 namespace cs {
@@ -93,6 +268,840 @@ namespace cs {
 		return true;
 	}
 
+	string_pool *string_pool::local()
+	{
+		static string_pool *pool = new string_pool;
+		return pool;
+	}
+
+	string_pool *string_pool::current()
+	{
+		// Process context may not be constructed yet during static initialization of extensions
+		string_pool *pool = current_process->symbols;
+		return pool != nullptr ? pool : local();
+	}
+
+	string_pool::entry *string_pool::intern(const std::string &str)
+	{
+		std::size_t code = std::hash<std::string>()(str);
+		std::lock_guard<std::mutex> guard(m_lock);
+		auto range = m_entries.equal_range(code);
+		for (auto it = range.first; it != range.second; ++it) {
+			if (it->second->str == str) {
+				acquire(it->second);
+				return it->second;
+			}
+		}
+		entry *ptr = new entry(code, str, this);
+		try {
+			m_entries.emplace(code, ptr);
+		}
+		catch (...) {
+			delete ptr;
+			throw;
+		}
+		return ptr;
+	}
+
+	void string_pool::erase(entry *ptr) noexcept
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		if (ptr->refcount.fetch_sub(1, std::memory_order_acq_rel) != 1)
+			return;
+		auto range = m_entries.equal_range(ptr->hash);
+		for (auto it = range.first; it != range.second; ++it) {
+			if (it->second == ptr) {
+				m_entries.erase(it);
+				break;
+			}
+		}
+		delete ptr;
+	}
+
+	constexpr std::size_t slab_heap::granularity;
+	constexpr std::size_t slab_heap::classes;
+	constexpr std::size_t slab_heap::max_size;
+	constexpr std::size_t slab_heap::slab_size;
+	constexpr std::size_t slab_heap::cached_slabs;
+
+	struct slab_heap::slab {
+		size_class *owner = nullptr;
+		slab *prev = nullptr, *next = nullptr;
+		// Freed blocks, blocks from bump to end are never used
+		void *free_list = nullptr;
+		unsigned char *bump = nullptr, *end = nullptr;
+		std::size_t block_size = 0;
+		std::size_t used = 0;
+
+		bool full() const noexcept
+		{
+			return free_list == nullptr && bump + block_size > end;
+		}
+
+		void reset() noexcept
+		{
+			constexpr std::size_t align = alignof(std::max_align_t);
+			free_list = nullptr;
+			bump = reinterpret_cast<unsigned char *>(this) + (sizeof(slab) + align - 1) / align * align;
+			end = reinterpret_cast<unsigned char *>(this) + slab_size;
+		}
+	};
+
+	// Map size bytes aligned to their size, size is a multiple of slab_size
+	static void *map_aligned(std::size_t size) noexcept
+	{
+#ifdef COVSCRIPT_PLATFORM_WIN32
+		// Allocation granularity of VirtualAlloc is 64 KiB, which is the size of slabs
+		return VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+		// Map twice the size and trim the mapping to an aligned range
+		void *ptr = mmap(nullptr, 2 * size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (ptr == MAP_FAILED)
+			return nullptr;
+		std::uintptr_t addr = reinterpret_cast<std::uintptr_t>(ptr);
+		std::uintptr_t aligned = (addr + size - 1) & ~std::uintptr_t(size - 1);
+		if (aligned > addr)
+			munmap(ptr, aligned - addr);
+		if (aligned + size < addr + 2 * size)
+			munmap(reinterpret_cast<void *>(aligned + size), addr + 2 * size - aligned - size);
+		return reinterpret_cast<void *>(aligned);
+#endif
+	}
+
+	static void unmap_aligned(void *ptr, std::size_t size) noexcept
+	{
+#ifdef COVSCRIPT_PLATFORM_WIN32
+		VirtualFree(ptr, 0, MEM_RELEASE);
+#else
+		munmap(ptr, size);
+#endif
+	}
+
+#if defined(COVSCRIPT_SLAB_HUGEPAGE) && defined(MADV_HUGEPAGE)
+	constexpr std::size_t slab_heap::region_size;
+
+	static_assert(slab_heap::region_size / slab_heap::slab_size == 32, "Slabs of a region must fit a 32-bit mask");
+
+	void *slab_heap::map_slab()
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		for (auto &it: m_regions) {
+			if (it.second == ~std::uint32_t(0))
+				continue;
+			std::size_t index = 0;
+			while (it.second & (std::uint32_t(1) << index))
+				++index;
+			it.second |= std::uint32_t(1) << index;
+			return reinterpret_cast<void *>(it.first + index * slab_size);
+		}
+		void *region = map_aligned(region_size);
+		// Fall back to a plain slab if the region can not be mapped
+		if (region == nullptr)
+			return map_aligned(slab_size);
+		madvise(region, region_size, MADV_HUGEPAGE);
+		m_regions.emplace(reinterpret_cast<std::uintptr_t>(region), 1);
+		return region;
+	}
+
+	void slab_heap::unmap_slab(void *ptr) noexcept
+	{
+		std::uintptr_t addr = reinterpret_cast<std::uintptr_t>(ptr);
+		std::uintptr_t base = addr & ~std::uintptr_t(region_size - 1);
+		{
+			std::lock_guard<std::mutex> guard(m_lock);
+			auto it = m_regions.find(base);
+			if (it != m_regions.end()) {
+				it->second &= ~(std::uint32_t(1) << ((addr - base) / slab_size));
+				if (it->second == 0) {
+					m_regions.erase(it);
+					unmap_aligned(reinterpret_cast<void *>(base), region_size);
+				}
+				else {
+					// Other slabs of the region are live, only the pages of this slab are returned
+					madvise(ptr, slab_size, MADV_DONTNEED);
+				}
+				return;
+			}
+		}
+		unmap_aligned(ptr, slab_size);
+	}
+#else
+	void *slab_heap::map_slab()
+	{
+		return map_aligned(slab_size);
+	}
+
+	void slab_heap::unmap_slab(void *ptr) noexcept
+	{
+		unmap_aligned(ptr, slab_size);
+	}
+#endif
+
+	static void link_slab(slab_heap::slab *&head, slab_heap::slab *ptr) noexcept
+	{
+		ptr->prev = nullptr;
+		ptr->next = head;
+		if (head != nullptr)
+			head->prev = ptr;
+		head = ptr;
+	}
+
+	static void unlink_slab(slab_heap::slab *&head, slab_heap::slab *ptr) noexcept
+	{
+		if (ptr->prev != nullptr)
+			ptr->prev->next = ptr->next;
+		else
+			head = ptr->next;
+		if (ptr->next != nullptr)
+			ptr->next->prev = ptr->prev;
+		ptr->prev = ptr->next = nullptr;
+	}
+
+	slab_heap *slab_heap::current()
+	{
+		return pool_allocator::current()->heap();
+	}
+
+	void *slab_heap::allocate(std::size_t size)
+	{
+		std::size_t index = size > 0 ? (size - 1) / granularity : 0;
+		size_class &cls = m_classes[index];
+		std::lock_guard<std::mutex> guard(cls.lock);
+		slab *ptr = cls.partial;
+		if (ptr == nullptr) {
+			if (cls.spare != nullptr) {
+				ptr = cls.spare;
+				cls.spare = nullptr;
+			}
+			else {
+				ptr = ::new(acquire_slab()) slab;
+				ptr->owner = &cls;
+				ptr->block_size = (index + 1) * granularity;
+				++cls.slabs;
+			}
+			ptr->reset();
+			link_slab(cls.partial, ptr);
+		}
+		void *block = nullptr;
+		if (ptr->free_list != nullptr) {
+			block = ptr->free_list;
+			ptr->free_list = *static_cast<void **>(block);
+		}
+		else {
+			block = ptr->bump;
+			ptr->bump += ptr->block_size;
+		}
+		++ptr->used;
+		if (ptr->full())
+			unlink_slab(cls.partial, ptr);
+		return block;
+	}
+
+	void slab_heap::deallocate(void *block) noexcept
+	{
+		slab *ptr = reinterpret_cast<slab *>(reinterpret_cast<std::uintptr_t>(block) & ~std::uintptr_t(slab_size - 1));
+		size_class &cls = *ptr->owner;
+		slab *released = nullptr;
+		{
+			std::lock_guard<std::mutex> guard(cls.lock);
+			if (ptr->full())
+				link_slab(cls.partial, ptr);
+			*static_cast<void **>(block) = ptr->free_list;
+			ptr->free_list = block;
+			if (--ptr->used == 0) {
+				unlink_slab(cls.partial, ptr);
+				if (cls.spare == nullptr)
+					cls.spare = ptr;
+				else {
+					released = ptr;
+					--cls.slabs;
+				}
+			}
+		}
+		if (released != nullptr) {
+			released->~slab();
+			cls.heap->release_slab(released);
+		}
+	}
+
+	void *slab_heap::acquire_slab()
+	{
+		m_acquired.fetch_add(1, std::memory_order_relaxed);
+		{
+			std::lock_guard<std::mutex> guard(m_lock);
+			if (m_cached != nullptr) {
+				void *ptr = m_cached;
+				m_cached = *static_cast<void **>(ptr);
+				--m_cached_count;
+				return ptr;
+			}
+		}
+		void *ptr = map_slab();
+		if (ptr == nullptr)
+			throw std::bad_alloc();
+		return ptr;
+	}
+
+	void slab_heap::release_slab(void *ptr) noexcept
+	{
+		{
+			std::lock_guard<std::mutex> guard(m_lock);
+			if (m_cached_count < cached_slabs) {
+				*static_cast<void **>(ptr) = m_cached;
+				m_cached = ptr;
+				++m_cached_count;
+				return;
+			}
+		}
+		unmap_slab(ptr);
+	}
+
+	std::size_t slab_heap::size()
+	{
+		std::size_t count = 0;
+		for (auto &cls: m_classes) {
+			std::lock_guard<std::mutex> guard(cls.lock);
+			count += cls.slabs;
+		}
+		return count;
+	}
+
+	std::size_t slab_heap::trim()
+	{
+		std::size_t count = 0;
+		for (auto &cls: m_classes) {
+			slab *ptr = nullptr;
+			{
+				std::lock_guard<std::mutex> guard(cls.lock);
+				std::swap(ptr, cls.spare);
+				if (ptr != nullptr)
+					--cls.slabs;
+			}
+			if (ptr != nullptr) {
+				ptr->~slab();
+				unmap_slab(ptr);
+				++count;
+			}
+		}
+		void *cached = nullptr;
+		{
+			std::lock_guard<std::mutex> guard(m_lock);
+			std::swap(cached, m_cached);
+			m_cached_count = 0;
+		}
+		while (cached != nullptr) {
+			void *next = *static_cast<void **>(cached);
+			unmap_slab(cached);
+			cached = next;
+			++count;
+		}
+		return count;
+	}
+
+	constexpr std::size_t block_depot::window;
+	constexpr std::size_t idle_release::poll_interval;
+	constexpr std::size_t pool_allocator::default_min_magazines;
+	constexpr std::size_t pool_allocator::default_max_magazines;
+
+	class default_pool_allocator final : public pool_allocator {
+		using key_type = std::pair<std::size_t, std::size_t>;
+		std::mutex m_lock;
+		slab_heap m_heap;
+		std::map<key_type, std::shared_ptr<block_depot>> m_depots;
+		// High water marks of a loaded profile
+		std::map<key_type, std::size_t> m_profile;
+		std::size_t m_min_magazines = default_min_magazines;
+		std::size_t m_max_magazines = default_max_magazines;
+
+		static void release_block(void *ptr)
+		{
+			slab_heap::deallocate(ptr);
+		}
+
+	public:
+		slab_heap *heap() override
+		{
+			return &m_heap;
+		}
+
+		std::shared_ptr<block_depot> depot(std::size_t size, std::size_t capacity) override
+		{
+			std::lock_guard<std::mutex> guard(m_lock);
+			key_type key(size, capacity);
+			std::shared_ptr<block_depot> &ptr = m_depots[key];
+			if (!ptr) {
+				auto it = m_profile.find(key);
+				std::size_t reserved = it != m_profile.end() ? it->second : 0;
+				ptr = std::make_shared<block_depot>(reserved > capacity ? reserved : capacity, capacity * m_min_magazines,
+				                                    capacity * m_max_magazines, &release_block);
+				for (std::size_t i = 0; i < reserved; ++i) {
+					void *block = m_heap.allocate(size);
+					if (!ptr->reserve(block)) {
+						slab_heap::deallocate(block);
+						break;
+					}
+				}
+			}
+			return ptr;
+		}
+
+		void set_depot_bounds(std::size_t min_magazines, std::size_t max_magazines) override
+		{
+			if (min_magazines > max_magazines)
+				throw cs::runtime_error("Invalid bounds of pool depots.");
+			std::lock_guard<std::mutex> guard(m_lock);
+			m_min_magazines = min_magazines;
+			m_max_magazines = max_magazines;
+		}
+
+		std::vector<pool_statistics> statistics() override
+		{
+			std::lock_guard<std::mutex> guard(m_lock);
+			std::vector<pool_statistics> stats;
+			for (auto &it: m_depots) {
+				stats.emplace_back();
+				stats.back().block_size = it.first.first;
+				stats.back().magazine_size = it.first.second;
+				it.second->statistics(stats.back());
+			}
+			return stats;
+		}
+
+		void save_profile(std::ostream &out) override
+		{
+			out << "# block_size magazine_size high_water" << std::endl;
+			for (auto &stats: statistics())
+				out << stats.block_size << " " << stats.magazine_size << " " << stats.high_water << std::endl;
+		}
+
+		void load_profile(std::istream &in) override
+		{
+			std::map<key_type, std::size_t> profile;
+			std::string line;
+			while (std::getline(in, line)) {
+				if (line.empty() || line[0] == '#')
+					continue;
+				std::istringstream ss(line);
+				std::size_t size = 0, capacity = 0, high_water = 0;
+				if (!(ss >> size >> capacity >> high_water) || size == 0 || size > slab_heap::max_size)
+					throw cs::runtime_error("Malformed pool profile: " + line);
+				profile[key_type(size, capacity)] = high_water;
+			}
+			std::lock_guard<std::mutex> guard(m_lock);
+			m_profile.swap(profile);
+		}
+
+		std::size_t release_memory() override
+		{
+			{
+				std::lock_guard<std::mutex> guard(m_lock);
+				for (auto &it: m_depots)
+					it.second->trim();
+			}
+			std::size_t bytes = m_heap.trim() * slab_heap::slab_size;
+#ifdef __GLIBC__
+			// Blocks larger than slab_heap::max_size come from malloc, which advises the system of its free pages
+			malloc_trim(0);
+#endif
+			return bytes;
+		}
+	};
+
+	constexpr std::size_t memory_budget::grant_size;
+
+	memory_budget *memory_budget::local()
+	{
+		static memory_budget *budget = new memory_budget;
+		return budget;
+	}
+
+	memory_budget *memory_budget::current()
+	{
+		memory_budget *budget = current_process->var_budget;
+		return budget != nullptr ? budget : local();
+	}
+
+	// Return credit of exiting threads
+	struct memory_budget::thread_guard final {
+		~thread_guard()
+		{
+			thread_cache &cache = current_cache();
+			if (cache.budget != nullptr)
+				cache.budget->give_back(cache.credit);
+			cache.credit = 0;
+			// Magazines of pools may still be returned
+			cache.reserve = 0;
+		}
+	};
+
+	void memory_budget::charge_slow(std::size_t bytes)
+	{
+		static thread_local thread_guard guard;
+		thread_cache &cache = current_cache();
+		memory_budget *budget = current();
+		if (cache.budget != budget) {
+			if (cache.budget != nullptr)
+				cache.budget->give_back(cache.credit);
+			cache.budget = budget;
+			cache.credit = 0;
+		}
+		std::size_t needed = bytes - cache.credit;
+		std::size_t grant = needed > cache.reserve / 2 ? needed : cache.reserve / 2;
+		if (!budget->take(grant)) {
+			grant = needed;
+			if (!budget->take(grant))
+				throw cs::runtime_error("Out of memory budget: " + std::to_string(budget->used()) + " of " +
+				                        std::to_string(budget->limit()) + " bytes used, " + std::to_string(bytes) +
+				                        " more requested.");
+		}
+		cache.credit += grant - bytes;
+	}
+
+	void memory_budget::refund_slow() noexcept
+	{
+		static thread_local thread_guard guard;
+		thread_cache &cache = current_cache();
+		if (cache.budget == nullptr)
+			cache.budget = current();
+		std::size_t kept = cache.reserve / 2;
+		if (cache.credit > kept) {
+			cache.budget->give_back(cache.credit - kept);
+			cache.credit = kept;
+		}
+	}
+
+	pool_allocator *pool_allocator::local()
+	{
+		static pool_allocator *allocator = new default_pool_allocator;
+		return allocator;
+	}
+
+	pool_allocator *pool_allocator::current()
+	{
+		// Process context may not be constructed yet during static initialization of extensions
+		pool_allocator *allocator = current_process->pools;
+		return allocator != nullptr ? allocator : local();
+	}
+
+	/*
+	* The arena holds one reference to each of its chunks until it is closed, and the newest chunk holds
+	* current_bias more until its allocations are added. Blocks released by the thread of an open arena are
+	* counted in released instead. Chunks left with the reference of the arena only have no blocks in use
+	* and are reused.
+	*/
+	struct var_arena::chunk {
+		static constexpr std::size_t current_bias = slab_heap::slab_size;
+
+		// Slabs of size classes start with their owner instead, which is never null
+		void *tag = nullptr;
+		slab_heap *heap = nullptr;
+		chunk *next = nullptr;
+		std::atomic<std::size_t> live{1};
+		// Innermost arena slot of the owning thread while the arena is open
+		std::atomic<var_arena **> owner{nullptr};
+		std::size_t released = 0;
+		// Closed with blocks still referenced
+		bool pinned = false;
+
+		static chunk *of(void *ptr) noexcept
+		{
+			return reinterpret_cast<chunk *>(reinterpret_cast<std::uintptr_t>(ptr) & ~std::uintptr_t(slab_heap::slab_size - 1));
+		}
+
+		unsigned char *begin() noexcept
+		{
+			constexpr std::size_t align = alignof(std::max_align_t);
+			return reinterpret_cast<unsigned char *>(this) + (sizeof(chunk) + align - 1) / align * align;
+		}
+
+		unsigned char *end() noexcept
+		{
+			return reinterpret_cast<unsigned char *>(this) + slab_heap::slab_size;
+		}
+
+		// Return the count of references left
+		std::size_t unref(std::size_t count) noexcept
+		{
+			std::size_t left = live.fetch_sub(count, std::memory_order_acq_rel) - count;
+			if (left == 0) {
+				slab_heap *owner = heap;
+				if (pinned)
+					pinned_slabs.fetch_sub(1, std::memory_order_relaxed);
+				this->~chunk();
+				owner->release_slab(this);
+				memory_budget::refund(slab_heap::slab_size);
+			}
+			return left;
+		}
+	};
+
+	constexpr std::size_t var_arena::chunk::current_bias;
+
+	std::atomic<std::size_t> var_arena::escaped_blocks{0}, var_arena::pinned_slabs{0};
+
+	void var_arena::grow()
+	{
+		// Chunks are charged against the memory budget as a whole, before the arena changes
+		memory_budget::charge(slab_heap::slab_size);
+		chunk *ptr = nullptr;
+		if (m_chunks != nullptr) {
+			m_chunks->live.fetch_add(m_allocated - chunk::current_bias, std::memory_order_acq_rel);
+			m_allocated = 0;
+			for (chunk **it = &m_chunks; *it != nullptr; it = &(*it)->next) {
+				if ((*it)->live.load(std::memory_order_acquire) - (*it)->released == 1) {
+					ptr = *it;
+					*it = ptr->next;
+					ptr->live.fetch_sub(ptr->released, std::memory_order_relaxed);
+					ptr->released = 0;
+					memory_budget::refund(slab_heap::slab_size);
+					break;
+				}
+			}
+		}
+		if (ptr == nullptr) {
+			slab_heap *heap = slab_heap::current();
+			try {
+				ptr = ::new(heap->acquire_slab()) chunk;
+			}
+			catch (...) {
+				memory_budget::refund(slab_heap::slab_size);
+				throw;
+			}
+			ptr->heap = heap;
+			ptr->owner.store(&innermost(), std::memory_order_relaxed);
+		}
+		ptr->live.fetch_add(chunk::current_bias, std::memory_order_relaxed);
+		ptr->next = m_chunks;
+		m_chunks = ptr;
+		m_bump = ptr->begin();
+		m_end = ptr->end();
+	}
+
+	void var_arena::release(void *ptr) noexcept
+	{
+		chunk *owner = chunk::of(ptr);
+		if (owner->owner.load(std::memory_order_relaxed) == &innermost())
+			++owner->released;
+		else
+			owner->unref(1);
+	}
+
+	bool var_arena::contains(const void *ptr) noexcept
+	{
+		return chunk::of(const_cast<void *>(ptr))->tag == nullptr;
+	}
+
+	std::size_t var_arena::close()
+	{
+		if (m_closed)
+			return 0;
+		m_closed = true;
+		// Arenas are nested in their thread
+		assert(innermost() == this);
+		innermost() = m_prev;
+		if (m_chunks != nullptr)
+			m_chunks->live.fetch_add(m_allocated - chunk::current_bias, std::memory_order_acq_rel);
+		std::size_t escaped = 0;
+		for (chunk *ptr = m_chunks, *next = nullptr; ptr != nullptr; ptr = next) {
+			next = ptr->next;
+			ptr->owner.store(nullptr, std::memory_order_relaxed);
+			// Marked before the last reference may be dropped by another thread
+			std::size_t left = ptr->live.load(std::memory_order_acquire) - ptr->released - 1;
+			if (left > 0) {
+				ptr->pinned = true;
+				pinned_slabs.fetch_add(1, std::memory_order_relaxed);
+			}
+			left = ptr->unref(ptr->released + 1);
+			escaped += left;
+		}
+		escaped_blocks.fetch_add(escaped, std::memory_order_relaxed);
+		m_chunks = nullptr;
+		m_bump = m_end = nullptr;
+		m_allocated = 0;
+		return escaped;
+	}
+
+#ifdef COVSCRIPT_VAR_STATISTICS
+	statistics_registry *statistics_registry::local()
+	{
+		static statistics_registry *reg = new statistics_registry;
+		return reg;
+	}
+#endif
+
+#ifdef COVSCRIPT_VAR_DEFERRED_RELEASE
+	release_queue::~release_queue()
+	{
+		// Objects still queued at exit are left to the system
+		stop_worker();
+	}
+
+	bool release_queue::push(void *object, void (*release)(void *)) noexcept
+	{
+		try {
+			std::lock_guard<std::mutex> guard(m_lock);
+			m_queue.push_back({object, release});
+			return true;
+		}
+		catch (...) {
+			return false;
+		}
+	}
+
+	std::size_t release_queue::drain(std::size_t budget)
+	{
+		std::size_t count = 0;
+		while (count < budget) {
+			entry e;
+			{
+				std::lock_guard<std::mutex> guard(m_lock);
+				if (m_queue.empty())
+					break;
+				e = m_queue.front();
+				m_queue.pop_front();
+			}
+			e.release(e.object);
+			++count;
+		}
+		return count;
+	}
+
+	void release_queue::start_worker(std::size_t interval_ms)
+	{
+		if (!cs_impl::default_refcount::concurrent)
+			throw runtime_error("Worker of deferred release requires biased reference counts.");
+		if (m_worker.joinable())
+			throw runtime_error("Worker of deferred release is already running.");
+		m_stop = false;
+		m_worker = std::thread([this, interval_ms] {
+			thread_guard guard;
+			std::unique_lock<std::mutex> lock(m_lock);
+			while (!m_stop) {
+				m_wakeup.wait_for(lock, std::chrono::milliseconds(interval_ms));
+				lock.unlock();
+				drain();
+				lock.lock();
+			}
+		});
+	}
+
+	void release_queue::stop_worker()
+	{
+		if (m_worker.joinable()) {
+			{
+				std::lock_guard<std::mutex> guard(m_lock);
+				m_stop = true;
+			}
+			m_wakeup.notify_all();
+			m_worker.join();
+		}
+	}
+#endif
+
+#ifdef COVSCRIPT_VAR_CYCLE_COLLECTOR
+	std::size_t cycle_collector::collect()
+	{
+		using proxy = cs_impl::any::proxy;
+		struct node {
+			std::size_t refs;
+			bool live;
+		};
+		// Only one thread collects at a time
+		if (m_collecting.exchange(true))
+			return 0;
+		m_allocated.store(0, std::memory_order_relaxed);
+		map_t<proxy *, node> graph;
+		std::vector<proxy *> order, pending, children, garbage;
+		// Containers referenced by payload of a proxy, copies and snapshots refer to the proxy they read
+		auto trace = [&children](proxy *ptr) {
+			children.clear();
+			if (ptr->source() != nullptr)
+				children.push_back(ptr->source());
+			else if (ptr->data() != nullptr)
+				ptr->ops()->trace(ptr->data(), [](const cs_impl::any &val, void *ctx) {
+					proxy *child = val.mDat.get();
+					if (child != nullptr && child->ops() != nullptr && child->ops()->traced)
+						static_cast<std::vector<proxy *> *>(ctx)->push_back(child);
+				}, &children);
+		};
+		auto insert = [&graph, &pending](proxy *ptr) {
+			if (graph.emplace(ptr, node{ptr->refcount.count(), false}).second)
+				pending.push_back(ptr);
+		};
+		std::unique_lock<std::mutex> lock(m_lock);
+		try {
+			for (void *it: m_suspects) {
+				proxy *ptr = static_cast<proxy *>(it);
+				ptr->set(cs_impl::any::proxy::flag_suspected, false);
+				if (ptr->ops() != nullptr && ptr->ops()->traced)
+					insert(ptr);
+			}
+			m_suspects.clear();
+			while (!pending.empty()) {
+				proxy *ptr = pending.back();
+				pending.pop_back();
+				order.push_back(ptr);
+				trace(ptr);
+				for (proxy *child: children)
+					insert(child);
+			}
+			// Subtract references between traced containers
+			for (proxy *ptr: order) {
+				trace(ptr);
+				for (proxy *child: children)
+					--graph[child].refs;
+			}
+			// Containers referenced from elsewhere keep everything they reach alive
+			for (proxy *ptr: order) {
+				node &n = graph[ptr];
+				if (n.refs == 0 || n.live)
+					continue;
+				n.live = true;
+				pending.push_back(ptr);
+				while (!pending.empty()) {
+					proxy *top = pending.back();
+					pending.pop_back();
+					trace(top);
+					for (proxy *child: children) {
+						node &c = graph[child];
+						if (!c.live) {
+							c.live = true;
+							pending.push_back(child);
+						}
+					}
+				}
+			}
+			m_report = cycle_report();
+			m_report.scanned = order.size();
+			for (proxy *ptr: order)
+				if (!graph[ptr].live)
+					garbage.push_back(ptr);
+			for (proxy *ptr: garbage)
+				++m_report.types[cs_impl::cxx_demangle(ptr->ops()->get_type_name())];
+		}
+		catch (...) {
+			lock.unlock();
+			m_collecting = false;
+			throw;
+		}
+		// Hold the garbage while breaking the cycles, then release all of them, which suspects and forgets containers again
+		for (proxy *ptr: garbage)
+			ptr->refcount.increase();
+		lock.unlock();
+		for (proxy *ptr: garbage)
+			if (ptr->source() == nullptr && ptr->data() != nullptr)
+				ptr->ops()->clear(ptr->data());
+		for (proxy *ptr: garbage)
+			cs_impl::any::release_reference(ptr);
+		lock.lock();
+		m_report.reclaimed = garbage.size();
+		m_reclaimed += garbage.size();
+		lock.unlock();
+		m_collecting = false;
+		return garbage.size();
+	}
+#endif
+
 	process_context this_process;
 	process_context *current_process = &this_process;
 
@@ -141,4 +1150,10 @@ namespace cs {
 	}
 
 	garbage_collector<cov::dll> extension::gc;
-}
\ No newline at end of file
+}
+std::ostream &operator<<(std::ostream &out, const cs_impl::any &val)
+{
+	std::string str;
+	val.to_string(str);
+	return out.write(str.data(), static_cast<std::streamsize>(str.size()));
+}
@@ -280,6 +280,17 @@ namespace cs_impl {
 			return str.c_str();
 		}
 	};
+
+// cs::interned_string->cs::string
+	template<>
+	struct type_conversion_cs<cs::interned_string> {
+		using source_type = cs::string;
+	};
+
+	template<>
+	struct type_conversion_cpp<cs::interned_string> {
+		using target_type = cs::string;
+	};
 }
 #endif
 
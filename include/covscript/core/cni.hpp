@@ -42,11 +42,12 @@ namespace cs_impl {
 	};
 
 // Type conversion
+// Types are checked by try_convert_and_check, mutable references still check protect level
 	template<typename T>
 	struct convert_helper {
 		static inline const T &get_val(any &val)
 		{
-			return val.const_val<T>();
+			return val.unchecked_const_val<T>();
 		}
 	};
 
@@ -54,7 +55,7 @@ namespace cs_impl {
 	struct convert_helper<const T &> {
 		static inline const T &get_val(any &val)
 		{
-			return val.const_val<T>();
+			return val.unchecked_const_val<T>();
 		}
 	};
 
@@ -66,6 +67,15 @@ namespace cs_impl {
 		}
 	};
 
+	// Numerics passed by value are copied without a reference, so boxed numerics stay boxed
+	template<>
+	struct convert_helper<cs::numeric> {
+		static inline cs::numeric get_val(any &val)
+		{
+			return val.numeric_value();
+		}
+	};
+
 	template<>
 	struct convert_helper<const any &> {
 		static inline const any &get_val(const any &val)
@@ -112,7 +122,7 @@ namespace cs_impl {
 	struct check_args_helper {
 		static inline char check(const any &val)
 		{
-			if (typeid(T) != val.type())
+			if (!val.is_type_of<T>())
 				throw cs::runtime_error("Invalid Argument. At " + std::to_string(index + 1) + ". Expected " +
 				                        cxx_demangle(get_name_of_type<T>()) + ", provided " + val.get_type_name());
 			else
@@ -151,9 +161,9 @@ namespace cs_impl {
 	struct try_convert_and_check {
 		inline static _TargetT convert(cs::var &val)
 		{
-			if (val.type() == typeid(_SourceT))
+			if (val.is_type_of<_SourceT>())
 				return type_convertor<_SourceT, _TargetT>::convert(convert_helper<_SourceT>::get_val(val));
-			else if (val.type() == typeid(_TargetT))
+			else if (val.is_type_of<_TargetT>())
 				return convert_helper<_TargetT>::get_val(val);
 			else
 				throw cs::runtime_error("Invalid Argument. At " + std::to_string(index + 1) + ". Expected " +
@@ -167,7 +177,7 @@ namespace cs_impl {
 	struct try_convert_and_check<_TargetT, _TargetT, _CheckT, index> {
 		inline static _TargetT convert(cs::var &val)
 		{
-			if (val.type() == typeid(_TargetT))
+			if (val.is_type_of<_TargetT>())
 				return convert_helper<_TargetT>::get_val(val);
 			else
 				throw cs::runtime_error("Invalid Argument. At " + std::to_string(index + 1) + ". Expected " +
@@ -176,6 +186,40 @@ namespace cs_impl {
 		}
 	};
 
+// Interned strings are accepted by strings passed by value or constant reference
+	template<typename T, std::size_t index>
+	struct convert_interned_helper {
+		static inline const cs::string &get_val(any &val)
+		{
+			return val.unchecked_const_val<cs::interned_string>().str();
+		}
+	};
+
+// Interned strings can not be written in place
+	template<std::size_t index>
+	struct convert_interned_helper<cs::string &, index> {
+		static inline cs::string &get_val(any &)
+		{
+			throw cs::runtime_error("Invalid Argument. At " + std::to_string(index + 1) + ". Expected " +
+			                        cxx_demangle(get_name_of_type<cs::string>()) + ", interned string can not be passed by non-constant reference");
+		}
+	};
+
+	template<typename _TargetT, std::size_t index>
+	struct try_convert_and_check<_TargetT, _TargetT, cs::string, index> {
+		inline static _TargetT convert(cs::var &val)
+		{
+			if (val.is_type_of<cs::string>())
+				return convert_helper<_TargetT>::get_val(val);
+			else if (val.is_type_of<cs::interned_string>())
+				return convert_interned_helper<_TargetT, index>::get_val(val);
+			else
+				throw cs::runtime_error("Invalid Argument. At " + std::to_string(index + 1) + ". Expected " +
+				                        cxx_demangle(get_name_of_type<_TargetT>()) + ", provided " +
+				                        val.get_type_name());
+		}
+	};
+
 	template<typename _TargetT, std::size_t index>
 	struct try_convert_and_check<_TargetT, _TargetT, cs::var, index> {
 		inline static _TargetT convert(cs::var &val)
@@ -206,18 +250,55 @@ namespace cs_impl {
 		result_container(check_conversion_base<_Target_ArgsT, _Source_ArgsT>()...);
 	}
 
-	template<typename T>
-	static inline any return_to_cs(const T &val)
+	template<typename T, typename = typename std::enable_if<!std::is_same<typename std::decay<T>::type, any>::value>::type>
+	static inline any return_to_cs(T &&val)
 	{
-		return any::make_constant<T>(val);
+		return any::make_constant<typename std::decay<T>::type>(std::forward<T>(val));
 	}
 
-	template<>
-	inline any return_to_cs<any>(const any &val)
+	static inline any return_to_cs(const any &val)
 	{
 		return val;
 	}
 
+	static inline any return_to_cs(any &&val)
+	{
+		return std::move(val);
+	}
+
+// Borrowing of arguments
+	template<typename T>
+	struct is_borrowed_argument : std::integral_constant<bool,
+		        std::is_lvalue_reference<T>::value && !std::is_const<typename std::remove_reference<T>::type>::value &&
+		        !std::is_same<typename std::decay<T>::type, any>::value> {
+	};
+
+	/*
+	* Mutable references bound to arguments end with the call, so copies may share them again afterwards.
+	* Arguments exposed before the call are left alone, their references may still be used by the caller.
+	*/
+	template<bool...Borrowed>
+	class borrow_scope final {
+		cs::vector &m_args;
+		bool m_exposed[sizeof...(Borrowed) + 1];
+	public:
+		explicit borrow_scope(cs::vector &args) : m_args(args)
+		{
+			constexpr bool borrowed[] = {Borrowed..., false};
+			for (std::size_t i = 0; i < sizeof...(Borrowed); ++i)
+				m_exposed[i] = !borrowed[i] || args[i].is_exposed();
+		}
+
+		borrow_scope(const borrow_scope &) = delete;
+
+		~borrow_scope()
+		{
+			for (std::size_t i = 0; i < sizeof...(Borrowed); ++i)
+				if (!m_exposed[i])
+					m_args[i].end_borrow();
+		}
+	};
+
 // CNI Helper
 	template<typename _Target, typename _Source>
 	class cni_helper;
@@ -251,6 +332,7 @@ namespace cs_impl {
 				    "Wrong size of the arguments. Expected " + std::to_string(sizeof...(_Target_ArgsT)) +
 				    ", provided " +
 				    std::to_string(args.size()));
+			borrow_scope<(is_borrowed_argument<_Target_ArgsT>::value || is_borrowed_argument<_Source_ArgsT>::value)...> scope(args);
 			_call(args, cov::make_sequence<sizeof...(_Source_ArgsT)>::result);
 			return cs::null_pointer;
 		}
@@ -286,6 +368,7 @@ namespace cs_impl {
 				    "Wrong size of the arguments. Expected " + std::to_string(sizeof...(_Target_ArgsT)) +
 				    ", provided " +
 				    std::to_string(args.size()));
+			borrow_scope<(is_borrowed_argument<_Target_ArgsT>::value || is_borrowed_argument<_Source_ArgsT>::value)...> scope(args);
 			return return_to_cs(_call(args, cov::make_sequence<sizeof...(_Source_ArgsT)>::result));
 		}
 	};
@@ -25,7 +25,22 @@
 * Website: https://covscript.org.cn
 */
 #include <covscript/import/mozart/base.hpp>
+#include <cstddef>
+#include <cassert>
 #include <atomic>
+#include <memory>
+#include <vector>
+#include <mutex>
+#include <iosfwd>
+#include <cstdint>
+#include <map>
+
+// Keeps slow paths out of inlined fast paths
+#ifdef _MSC_VER
+#define COVSCRIPT_NOINLINE __declspec(noinline)
+#else
+#define COVSCRIPT_NOINLINE __attribute__((noinline))
+#endif
 
 namespace cs {
 	extern std::atomic_size_t global_thread_counter;
@@ -608,45 +623,764 @@ namespace cs {
 	};
 
 // Buffer Pool
+	// Usage of a depot, blocks are counted when magazines exchange them with the depot
+	struct pool_statistics {
+		// Size of blocks and capacity of magazines, which identify a depot
+		std::size_t block_size = 0;
+		std::size_t magazine_size = 0;
+		// Allocations served by magazines, and refills the depot could not serve
+		std::size_t hits = 0;
+		std::size_t misses = 0;
+		// Most free blocks held by the depot
+		std::size_t high_water = 0;
+		// Exchanges with magazines, which tell whether the depot is idle
+		std::size_t exchanges = 0;
+		std::size_t capacity = 0;
+		std::size_t size = 0;
+	};
+
+	/*
+	* Free blocks of one size shared by the magazines of all threads.
+	* The capacity doubles whenever a refill finds the depot empty, and halves when more than half of it stayed
+	* unused for a window of exchanges without misses, always within the bounds of the depot.
+	*/
+	class block_depot final {
+		static constexpr std::size_t window = 64;
+
+		std::mutex m_lock;
+		std::vector<void *> m_blocks;
+		std::size_t m_capacity;
+		std::size_t m_min_capacity;
+		std::size_t m_max_capacity;
+		void (*m_release)(void *);
+		std::size_t m_hits = 0;
+		std::size_t m_misses = 0;
+		std::size_t m_high_water = 0;
+		std::size_t m_total_exchanges = 0;
+		// Exchanges, misses and fewest free blocks in current window
+		std::size_t m_exchanges = 0;
+		std::size_t m_window_misses = 0;
+		std::size_t m_low_water = 0;
+
+		void exchanged()
+		{
+			if (m_blocks.size() > m_high_water)
+				m_high_water = m_blocks.size();
+			if (m_exchanges == 0 || m_blocks.size() < m_low_water)
+				m_low_water = m_blocks.size();
+			++m_total_exchanges;
+			if (++m_exchanges < window)
+				return;
+			if (m_window_misses == 0 && m_low_water > m_capacity / 2) {
+				m_capacity = m_capacity / 2 > m_min_capacity ? m_capacity / 2 : m_min_capacity;
+				while (m_blocks.size() > m_capacity) {
+					m_release(m_blocks.back());
+					m_blocks.pop_back();
+				}
+			}
+			m_exchanges = m_window_misses = 0;
+		}
+
+	public:
+		block_depot(std::size_t capacity, std::size_t min_capacity, std::size_t max_capacity, void (*release)(void *)) :
+			m_capacity(capacity), m_min_capacity(min_capacity), m_max_capacity(max_capacity), m_release(release)
+		{
+			if (m_capacity < m_min_capacity)
+				m_capacity = m_min_capacity;
+			if (m_capacity > m_max_capacity)
+				m_capacity = m_max_capacity;
+		}
+
+		block_depot(const block_depot &) = delete;
+
+		~block_depot()
+		{
+			for (void *ptr: m_blocks)
+				m_release(ptr);
+		}
+
+		// Take up to count blocks, return the number of blocks taken
+		std::size_t get(void **blocks, std::size_t count, std::size_t hits)
+		{
+			std::lock_guard<std::mutex> guard(m_lock);
+			std::size_t taken = 0;
+			for (; taken < count && !m_blocks.empty(); ++taken) {
+				blocks[taken] = m_blocks.back();
+				m_blocks.pop_back();
+			}
+			m_hits += hits;
+			if (taken == 0) {
+				++m_misses;
+				++m_window_misses;
+				std::size_t capacity = m_capacity > 0 ? m_capacity * 2 : count;
+				m_capacity = capacity < m_max_capacity ? capacity : m_max_capacity;
+			}
+			exchanged();
+			return taken;
+		}
+
+		// Blocks exceeding the capacity are released
+		void put(void **blocks, std::size_t count, std::size_t hits)
+		{
+			std::lock_guard<std::mutex> guard(m_lock);
+			for (std::size_t i = 0; i < count; ++i) {
+				if (m_blocks.size() < m_capacity)
+					m_blocks.push_back(blocks[i]);
+				else
+					m_release(blocks[i]);
+			}
+			m_hits += hits;
+			exchanged();
+		}
+
+		// Keep a block allocated ahead of use, return false if the depot is full
+		bool reserve(void *ptr)
+		{
+			std::lock_guard<std::mutex> guard(m_lock);
+			if (m_blocks.size() >= m_capacity)
+				return false;
+			m_blocks.push_back(ptr);
+			if (m_blocks.size() > m_high_water)
+				m_high_water = m_blocks.size();
+			return true;
+		}
+
+		std::size_t size()
+		{
+			std::lock_guard<std::mutex> guard(m_lock);
+			return m_blocks.size();
+		}
+
+		// Release all free blocks and shrink to the lower bound, return the number of blocks released
+		std::size_t trim()
+		{
+			std::lock_guard<std::mutex> guard(m_lock);
+			std::size_t count = m_blocks.size();
+			for (void *ptr: m_blocks)
+				m_release(ptr);
+			m_blocks.clear();
+			m_blocks.shrink_to_fit();
+			m_capacity = m_min_capacity;
+			m_exchanges = m_window_misses = 0;
+			return count;
+		}
+
+		// Fill in counters, the identity of the depot is left to the caller
+		void statistics(pool_statistics &stats)
+		{
+			std::lock_guard<std::mutex> guard(m_lock);
+			stats.hits = m_hits;
+			stats.misses = m_misses;
+			stats.high_water = m_high_water;
+			stats.exchanges = m_total_exchanges;
+			stats.capacity = m_capacity;
+			stats.size = m_blocks.size();
+		}
+	};
+
+	/*
+	* Slab Heap
+	* Blocks of the same size class share slabs of slab_size bytes. Slabs are aligned to their size, so every
+	* block finds its slab and the heap it came from, and may be freed by any module of the process.
+	* Each size class keeps at most one empty slab, the heap caches up to cached_slabs more for any size class
+	* or arena and returns the others to the system.
+	* With COVSCRIPT_SLAB_HUGEPAGE on Linux, slabs are carved from regions of region_size bytes advised to be
+	* backed by transparent huge pages, so hot blocks share few TLB entries. A region is unmapped once all of its
+	* slabs are returned, slabs returned before that give their pages back with MADV_DONTNEED.
+	*/
+	class slab_heap final {
+	public:
+		static constexpr std::size_t granularity = 16;
+		static constexpr std::size_t classes = 32;
+		static constexpr std::size_t max_size = granularity * classes;
+		static constexpr std::size_t slab_size = 64 * 1024;
+		static constexpr std::size_t cached_slabs = 16;
+
+		struct slab;
+
+		struct size_class {
+			slab_heap *heap = nullptr;
+			std::mutex lock;
+			// Slabs with free blocks
+			slab *partial = nullptr;
+			slab *spare = nullptr;
+			std::size_t slabs = 0;
+		};
+
+	private:
+		size_class m_classes[classes];
+		std::mutex m_lock;
+		// Empty slabs linked through their first word
+		void *m_cached = nullptr;
+		std::size_t m_cached_count = 0;
+		std::atomic<std::size_t> m_acquired{0};
+#ifdef COVSCRIPT_SLAB_HUGEPAGE
+		// Slabs in use of each region by base address
+		std::map<std::uintptr_t, std::uint32_t> m_regions;
+#endif
+
+		// Memory of slabs, carved from regions backed by transparent huge pages if enabled
+		void *map_slab();
+
+		void unmap_slab(void *) noexcept;
+
+	public:
+#ifdef COVSCRIPT_SLAB_HUGEPAGE
+		static constexpr std::size_t region_size = 2 * 1024 * 1024;
+#endif
+
+		slab_heap()
+		{
+			for (auto &cls: m_classes)
+				cls.heap = this;
+		}
+
+		slab_heap(const slab_heap &) = delete;
+
+		// Heap of the pool allocator of current process
+		static slab_heap *current();
+
+		// Size must not exceed max_size
+		void *allocate(std::size_t);
+
+		static void deallocate(void *) noexcept;
+
+		// Empty slab of slab_size bytes aligned to its size
+		void *acquire_slab();
+
+		void release_slab(void *) noexcept;
+
+		// Number of slabs held by the heap
+		std::size_t size();
+
+		// Return empty slabs to the system, return the number of slabs returned
+		std::size_t trim();
+
+		// Number of slabs acquired, counts the activity of arenas and pools
+		std::size_t acquired() const noexcept
+		{
+			return m_acquired.load(std::memory_order_relaxed);
+		}
+
+#ifdef COVSCRIPT_SLAB_HUGEPAGE
+		// Number of regions holding slabs, none if regions can not be mapped
+		std::size_t regions()
+		{
+			std::lock_guard<std::mutex> guard(m_lock);
+			return m_regions.size();
+		}
+#endif
+	};
+
+	/*
+	* Pool Allocator
+	* Owns the slab heap and the depots of pools backed by slab_provider. The process context carries the
+	* allocator of the host, which extensions adopt in __CS_EXTENSION_MAIN__, so pools of all modules share
+	* one set of depots and one heap. Hosts may install an implementation of their own to tune the pools of
+	* all modules in one place, before variables are created.
+	* A profile saved at exit holds the high water marks of depots, loading it on the next start lets depots
+	* begin at the size they reached instead of growing through misses again.
+	*/
+	class pool_allocator {
+	public:
+		// Bounds of the capacity of depots, in magazines
+		static constexpr std::size_t default_min_magazines = 1;
+		static constexpr std::size_t default_max_magazines = 8;
+
+		virtual ~pool_allocator() = default;
+
+		// Default allocator of current module, never destroyed
+		static pool_allocator *local();
+
+		// Allocator of current process
+		static pool_allocator *current();
+
+		virtual slab_heap *heap() = 0;
+
+		// Depot for pools of size byte blocks, which keep up to capacity blocks in each thread
+		virtual std::shared_ptr<block_depot> depot(std::size_t size, std::size_t capacity) = 0;
+
+		// Bounds of depots created afterwards
+		virtual void set_depot_bounds(std::size_t min_magazines, std::size_t max_magazines) = 0;
+
+		virtual std::vector<pool_statistics> statistics() = 0;
+
+		virtual void save_profile(std::ostream &) = 0;
+
+		// Size depots created afterwards by a saved profile
+		virtual void load_profile(std::istream &) = 0;
+
+		/*
+		* Release free blocks of depots and return empty slabs and free pages of the system heap to the system,
+		* return the number of bytes returned. Blocks cached by magazines of threads are kept.
+		*/
+		virtual std::size_t release_memory() = 0;
+	};
+
+	// Stateless provider of allocator_type, small objects are placed in slabs of the process heap
+	template<typename T>
+	class slab_provider final {
+	public:
+		static constexpr bool in_slab = sizeof(T) <= slab_heap::max_size && alignof(T) <= alignof(std::max_align_t);
+
+		using value_type = T;
+
+		slab_provider() = default;
+
+		template<typename X>
+		slab_provider(const slab_provider<X> &) {}
+
+		T *allocate(std::size_t n)
+		{
+			if (in_slab && n == 1)
+				return static_cast<T *>(slab_heap::current()->allocate(sizeof(T)));
+			else
+				return std::allocator<T>().allocate(n);
+		}
+
+		void deallocate(T *ptr, std::size_t n) noexcept
+		{
+			if (in_slab && n == 1)
+				slab_heap::deallocate(ptr);
+			else
+				std::allocator<T>().deallocate(ptr, n);
+		}
+
+		template<typename...ArgsT>
+		void construct(T *ptr, ArgsT &&...args)
+		{
+			::new(static_cast<void *>(ptr)) T(std::forward<ArgsT>(args)...);
+		}
+
+		void destroy(T *ptr) noexcept
+		{
+			ptr->~T();
+		}
+	};
+
+	// Pools keep private depots unless their blocks come from the slab heap
+	template<typename provider_t>
+	struct is_shared_provider {
+		static constexpr bool value = false;
+	};
+
+	template<typename T>
+	struct is_shared_provider<slab_provider<T>> {
+		static constexpr bool value = slab_provider<T>::in_slab;
+	};
+
+	/*
+	* Memory Budget
+	* Proxies and holders of variables charge their memory against the budget of current process when they
+	* are allocated, going over the limit raises cs::runtime_error before anything is allocated. Blocks
+	* cached by pools are not charged, arenas charge whole chunks. Threads take credit from the budget
+	* grant_size bytes at a time, so most charges only touch a counter of the thread, and the limit may be
+	* passed by the credit other threads hold. Buffers owned by payloads, such as the elements of containers
+	* or the text of strings, are not charged, only the holders of them.
+	* A budget must outlive the threads charging it.
+	*/
+	class memory_budget final {
+		struct thread_cache final {
+			memory_budget *budget = nullptr;
+			std::size_t credit = 0;
+			// Credit kept by the thread, none once it exits
+			std::size_t reserve = 2 * grant_size;
+		};
+
+		struct thread_guard;
+
+		std::atomic<std::size_t> m_used{0};
+		std::atomic<std::size_t> m_limit{0};
+
+		static thread_cache &current_cache() noexcept
+		{
+			static thread_local thread_cache cache;
+			return cache;
+		}
+
+		// Take credit if it fits the limit
+		bool take(std::size_t bytes) noexcept
+		{
+			std::size_t used = m_used.load(std::memory_order_relaxed);
+			do {
+				std::size_t limit = m_limit.load(std::memory_order_relaxed);
+				if (limit > 0 && (used > limit || bytes > limit - used))
+					return false;
+			}
+			while (!m_used.compare_exchange_weak(used, used + bytes, std::memory_order_relaxed));
+			return true;
+		}
+
+		void give_back(std::size_t bytes) noexcept
+		{
+			std::size_t used = m_used.load(std::memory_order_relaxed);
+			while (!m_used.compare_exchange_weak(used, used > bytes ? used - bytes : 0, std::memory_order_relaxed));
+		}
+
+		static void charge_slow(std::size_t);
+
+		static void refund_slow() noexcept;
+
+	public:
+		static constexpr std::size_t grant_size = 64 * 1024;
+
+		memory_budget() = default;
+
+		memory_budget(const memory_budget &) = delete;
+
+		// Budget of current module, never destroyed
+		static memory_budget *local();
+
+		// Budget of current process
+		static memory_budget *current();
+
+		// Zero means unlimited
+		std::size_t limit() const noexcept
+		{
+			return m_limit.load(std::memory_order_relaxed);
+		}
+
+		void set_limit(std::size_t limit) noexcept
+		{
+			m_limit.store(limit, std::memory_order_relaxed);
+		}
+
+		// Bytes charged, including credit held by threads
+		std::size_t used() const noexcept
+		{
+			return m_used.load(std::memory_order_relaxed);
+		}
+
+		static void charge(std::size_t bytes)
+		{
+			thread_cache &cache = current_cache();
+			if (cache.credit >= bytes)
+				cache.credit -= bytes;
+			else
+				charge_slow(bytes);
+		}
+
+		static void refund(std::size_t bytes) noexcept
+		{
+			thread_cache &cache = current_cache();
+			cache.credit += bytes;
+			if (cache.credit > cache.reserve)
+				refund_slow();
+		}
+	};
+
+	/*
+	* Each thread caches free blocks in a magazine of its own and exchanges half a magazine at a time with
+	* a depot, so blocks freed by another thread simply join the magazine of that thread. A magazine the
+	* depot can not refill allocates half a magazine of blocks at once.
+	* Magazines of exiting threads are returned to their depot, which lives as long as the pool or any magazine.
+	* Pools backed by slab_provider use the depot of the pool allocator of current process, and magazines follow
+	* when an extension adopts the process context of the host.
+	* Blocks are obtained from default constructed instances of allocator_t, which has to be stateless,
+	* so pools of the same type share the magazine of a thread.
+	*/
 	template<typename T, std::size_t blck_size, template<typename> class allocator_t=std::allocator>
 	class allocator_type final {
-		T *mPool[blck_size];
-		allocator_t<T> mAlloc;
-		std::size_t mOffset = 0;
+		static constexpr std::size_t batch_size = blck_size > 1 ? blck_size / 2 : 1;
+		static constexpr bool shared_depot = is_shared_provider<allocator_t<T>>::value;
+
+		struct magazine_type final {
+			std::shared_ptr<block_depot> depot;
+			// Allocator providing a shared depot
+			pool_allocator *owner = nullptr;
+			std::size_t size = 0;
+			// Allocations served since last exchange
+			std::size_t hits = 0;
+			void *blocks[blck_size];
+
+			void put(std::size_t count)
+			{
+				size -= count;
+				depot->put(blocks + size, count, hits);
+				hits = 0;
+			}
+
+			void get()
+			{
+				size += depot->get(blocks + size, batch_size, hits);
+				hits = 0;
+			}
+
+			// Allocate half a magazine ahead if the depot ran dry, so the next allocations hit the magazine
+			void fill()
+			{
+				try {
+					while (size < batch_size)
+						blocks[size++] = allocator_t<T>().allocate(1);
+				}
+				catch (...) {
+					if (size == 0)
+						throw;
+				}
+			}
+
+			void flush()
+			{
+				if (depot) {
+					put(size);
+					depot.reset();
+				}
+			}
+		};
+
+		// Trivial, so accessing it needs no initialization check of thread locals
+		struct thread_cache final {
+			magazine_type *magazine = nullptr;
+			bool retired = false;
+		};
+
+		struct thread_guard final {
+			~thread_guard()
+			{
+				thread_cache &cache = current_cache();
+				cache.retired = true;
+				if (cache.magazine != nullptr) {
+					cache.magazine->flush();
+					delete cache.magazine;
+					cache.magazine = nullptr;
+				}
+			}
+		};
+
+		std::shared_ptr<block_depot> mDepot;
+		bool mConstructed = false;
+
+		static thread_cache &current_cache() noexcept
+		{
+			static thread_local thread_cache cache;
+			return cache;
+		}
+
+		static void release_block(void *ptr)
+		{
+			allocator_t<T>().deallocate(static_cast<T *>(ptr), 1);
+		}
+
+		/*
+		* Magazine of current thread.
+		* Static pools may be used before they are constructed or after they are destroyed,
+		* blocks are allocated directly in that case and also while the thread exits.
+		*/
+		magazine_type *magazine()
+		{
+			thread_cache &cache = current_cache();
+			if (!mConstructed || cache.retired)
+				return nullptr;
+			if (cache.magazine == nullptr) {
+				static thread_local thread_guard guard;
+				cache.magazine = new magazine_type;
+			}
+			magazine_type *mag = cache.magazine;
+			if (shared_depot && mag->owner != pool_allocator::current()) {
+				mag->flush();
+				mag->owner = pool_allocator::current();
+				mag->depot = mag->owner->depot(sizeof(T), blck_size);
+			}
+			else if (!mag->depot)
+				mag->depot = mDepot;
+			return mag;
+		}
+
+		COVSCRIPT_NOINLINE T *refill()
+		{
+			magazine_type *mag = magazine();
+			if (mag != nullptr && mag->size == 0) {
+				mag->get();
+				if (mag->size == 0)
+					mag->fill();
+			}
+			if (mag != nullptr && mag->size > 0) {
+				++mag->hits;
+				return static_cast<T *>(mag->blocks[--mag->size]);
+			}
+			else
+				return allocator_t<T>().allocate(1);
+		}
+
+		COVSCRIPT_NOINLINE void drain(T *ptr)
+		{
+			magazine_type *mag = magazine();
+			if (mag != nullptr) {
+				if (mag->size == blck_size)
+					mag->put(batch_size);
+				mag->blocks[mag->size++] = ptr;
+			}
+			else
+				allocator_t<T>().deallocate(ptr, 1);
+		}
+
 	public:
 		allocator_type()
 		{
-			while (mOffset < 0.5 * blck_size)
-				mPool[mOffset++] = mAlloc.allocate(1);
+			// Depots start empty and grow on misses, so pools of unused types cost nothing
+			if (!shared_depot)
+				mDepot = std::make_shared<block_depot>(blck_size, blck_size * pool_allocator::default_min_magazines,
+				                                       blck_size * pool_allocator::default_max_magazines, &release_block);
+			mConstructed = true;
 		}
 
 		allocator_type(const allocator_type &) = delete;
 
 		~allocator_type()
 		{
-			while (mOffset > 0)
-				mAlloc.deallocate(mPool[--mOffset], 1);
+			mConstructed = false;
+			mDepot.reset();
 		}
 
 		template<typename...ArgsT>
 		inline T *alloc(ArgsT &&...args)
 		{
+			magazine_type *mag = current_cache().magazine;
 			T *ptr = nullptr;
-			if (mOffset > 0 && global_thread_counter == 0)
-				ptr = mPool[--mOffset];
+			if (mag != nullptr && mag->size > 0) {
+				++mag->hits;
+				ptr = static_cast<T *>(mag->blocks[--mag->size]);
+			}
 			else
-				ptr = mAlloc.allocate(1);
-			mAlloc.construct(ptr, std::forward<ArgsT>(args)...);
+				ptr = refill();
+			allocator_t<T>().construct(ptr, std::forward<ArgsT>(args)...);
 			return ptr;
 		}
 
 		inline void free(T *ptr)
 		{
-			mAlloc.destroy(ptr);
-			if (mOffset < blck_size && global_thread_counter == 0)
-				mPool[mOffset++] = ptr;
+			allocator_t<T>().destroy(ptr);
+			magazine_type *mag = current_cache().magazine;
+			if (mag != nullptr && mag->size < blck_size)
+				mag->blocks[mag->size++] = ptr;
 			else
-				mAlloc.deallocate(ptr, 1);
+				drain(ptr);
+		}
+	};
+
+	/*
+	* Arena of Variables
+	* While an arena is the innermost one of its thread, proxies of variables created by the thread and holders
+	* up to slab_heap::max_size bytes are bump allocated from slabs of the arena, and the slabs are released in
+	* bulk when the arena is closed. Slabs whose blocks are all released are reused by the arena. Each slab
+	* counts its blocks still referenced, so values escaping the arena keep their whole slab alive until they
+	* are released. Escaped blocks and the slabs they pin are counted for all arenas of the process, hosts
+	* should watch them to find scopes leaking values. Debug builds assert that no value escapes, unless close
+	* is called explicitly.
+	*/
+	class var_arena final {
+		struct chunk;
+
+		var_arena *m_prev = nullptr;
+		chunk *m_chunks = nullptr;
+		unsigned char *m_bump = nullptr, *m_end = nullptr;
+		// Blocks allocated from the newest chunk
+		std::size_t m_allocated = 0;
+		bool m_closed = false;
+
+		static std::atomic<std::size_t> escaped_blocks, pinned_slabs;
+
+		static var_arena *&innermost() noexcept
+		{
+			static thread_local var_arena *arena = nullptr;
+			return arena;
+		}
+
+		void grow();
+
+	public:
+		var_arena() : m_prev(innermost())
+		{
+			innermost() = this;
+		}
+
+		var_arena(const var_arena &) = delete;
+
+		~var_arena()
+		{
+			std::size_t escaped = close();
+			assert(escaped == 0);
+			(void) escaped;
+		}
+
+		// Innermost arena of current thread, or nullptr
+		static var_arena *current() noexcept
+		{
+			return innermost();
+		}
+
+		// Size must be a multiple of alignof(std::max_align_t) and much smaller than slab_size
+		void *allocate(std::size_t size)
+		{
+			if (static_cast<std::size_t>(m_end - m_bump) < size)
+				grow();
+			void *ptr = m_bump;
+			m_bump += size;
+			++m_allocated;
+			return ptr;
+		}
+
+		// Release a block allocated by any arena
+		static void release(void *) noexcept;
+
+		// Whether a block of the slab heap or of an arena was allocated by an arena
+		static bool contains(const void *) noexcept;
+
+		// Blocks still referenced when their arena was closed, since start of the process
+		static std::size_t escaped() noexcept
+		{
+			return escaped_blocks.load(std::memory_order_relaxed);
+		}
+
+		// Slabs of closed arenas kept alive by escaped blocks
+		static std::size_t pinned() noexcept
+		{
+			return pinned_slabs.load(std::memory_order_relaxed);
+		}
+
+		// Stop allocating from the arena and release its slabs, return the number of blocks still referenced
+		std::size_t close();
+	};
+
+	template<std::size_t N>
+	struct slab_block final {
+		alignas(std::max_align_t) unsigned char data[N * slab_heap::granularity];
+	};
+
+	template<std::size_t N, std::size_t blck_size>
+	struct slab_class_pool final {
+		using block_type = slab_block<N>;
+		static allocator_type<block_type, blck_size, slab_provider> pool;
+	};
+
+	template<std::size_t N, std::size_t blck_size> allocator_type<slab_block<N>, blck_size, slab_provider> slab_class_pool<N, blck_size>::pool;
+
+	// Buffer pool shared by all types of the same size class
+	template<typename T, std::size_t blck_size>
+	class slab_allocator final {
+		// T may be incomplete when the allocator is declared
+		template<typename X>
+		using pool_of = slab_class_pool<(sizeof(X) + slab_heap::granularity - 1) / slab_heap::granularity, blck_size>;
+	public:
+		template<typename...ArgsT>
+		inline T *alloc(ArgsT &&...args)
+		{
+			using pool_type = pool_of<T>;
+			typename pool_type::block_type *ptr = pool_type::pool.alloc();
+			try {
+				return ::new(static_cast<void *>(ptr)) T(std::forward<ArgsT>(args)...);
+			}
+			catch (...) {
+				pool_type::pool.free(ptr);
+				throw;
+			}
+		}
+
+		inline void free(T *ptr)
+		{
+			using pool_type = pool_of<T>;
+			ptr->~T();
+			pool_type::pool.free(reinterpret_cast<typename pool_type::block_type *>(ptr));
 		}
 	};
 
@@ -45,7 +45,17 @@
 #include <ostream>
 #include <utility>
 #include <cstring>
+#include <cstdio>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <cmath>
 #include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
 #include <cctype>
 #include <string>
 #include <vector>
@@ -54,19 +64,443 @@
 #include <list>
 // CovScript ABI Version
 // Must be different to SDK
-#define COVSCRIPT_ABI_VERSION 990307
+#define COVSCRIPT_ABI_VERSION 990600
 // CovScript Headers
 #include <covscript/core/components.hpp>
 #include <covscript/core/definition.hpp>
 #include <covscript/core/variable.hpp>
 
 namespace cs {
+// Allocation statistics of held type
+	struct var_statistics {
+		std::string type_name;
+		std::size_t live_count = 0;
+		std::size_t total_count = 0;
+		std::size_t live_bytes = 0;
+	};
+
+#ifdef COVSCRIPT_VAR_STATISTICS
+	class statistics_registry final {
+		std::mutex m_lock;
+		// Counters are referenced by slots of extensions, so they are never moved
+		std::deque<cs_impl::statistics_counter> m_counters;
+		map_t<std::string, cs_impl::statistics_counter *> m_names;
+	public:
+		statistics_registry() = default;
+
+		statistics_registry(const statistics_registry &) = delete;
+
+		// Registry of current module, available during static initialization and never destroyed
+		static statistics_registry *local();
+
+		cs_impl::statistics_counter &get(const std::string &name)
+		{
+			std::lock_guard<std::mutex> guard(m_lock);
+			auto it = m_names.find(name);
+			if (it != m_names.end())
+				return *it->second;
+			m_counters.emplace_back();
+			m_names.emplace(name, &m_counters.back());
+			return m_counters.back();
+		}
+
+		// Move counts of another registry into this one
+		void merge(statistics_registry &reg)
+		{
+			std::lock_guard<std::mutex> guard(reg.m_lock);
+			for (auto &it : reg.m_names) {
+				cs_impl::statistics_counter &counter = get(it.first);
+				counter.live += it.second->live.exchange(0);
+				counter.total += it.second->total.exchange(0);
+				counter.bytes += it.second->bytes.exchange(0);
+			}
+		}
+
+		std::vector<var_statistics> snapshot()
+		{
+			std::lock_guard<std::mutex> guard(m_lock);
+			std::vector<var_statistics> stats;
+			for (auto &it : m_names) {
+				stats.emplace_back();
+				stats.back().type_name = it.first;
+				stats.back().live_count = it.second->live.load();
+				stats.back().total_count = it.second->total.load();
+				stats.back().live_bytes = it.second->bytes.load();
+			}
+			return stats;
+		}
+	};
+#endif
+
+// Type Registry
+	class type_registry final {
+		std::mutex m_lock;
+		map_t<std::string, std::vector<std::pair<const std::type_info *, std::size_t>>> m_ids;
+		std::size_t m_count = 0;
+	public:
+		type_registry() = default;
+
+		type_registry(const type_registry &) = delete;
+
+		/*
+		* Assign IDs by mangled name, type_info objects may be duplicated between extensions.
+		* Types with internal linkage of different translation units may share their name,
+		* so types of the same name are told apart by type_info equality. Extensions are only unloaded
+		* on exit, so the type_info objects outlive the registry entries referring to them.
+		*/
+		std::size_t get_id(const std::type_info &info)
+		{
+			std::lock_guard<std::mutex> guard(m_lock);
+			auto &types = m_ids[info.name()];
+			for (auto &it: types)
+				if (*it.first == info)
+					return it.second;
+			types.emplace_back(&info, ++m_count);
+			return m_count;
+		}
+
+		std::size_t size()
+		{
+			std::lock_guard<std::mutex> guard(m_lock);
+			return m_count;
+		}
+	};
+
+#ifdef COVSCRIPT_VAR_DEFERRED_RELEASE
+/*
+* Deferred Release
+* When enabled, containers of variables losing their last reference are queued instead of released.
+* The queue is drained at safe points by process_context::poll_event or by a worker thread, at most
+* budget containers each time. Nested containers are queued again, so large graphs are released
+* incrementally. Drain the queue before unloading extensions whose types may be queued.
+*/
+	class release_queue final {
+		struct entry {
+			void *object;
+			void (*release)(void *);
+		};
+		std::mutex m_lock;
+		std::deque<entry> m_queue;
+		std::atomic<bool> m_enabled{false};
+		std::atomic<std::size_t> m_budget{64};
+		std::thread m_worker;
+		std::condition_variable m_wakeup;
+		bool m_stop = false;
+	public:
+		release_queue() = default;
+
+		release_queue(const release_queue &) = delete;
+
+		~release_queue();
+
+		bool enabled() const noexcept
+		{
+			return m_enabled.load(std::memory_order_relaxed);
+		}
+
+		// Release everything queued when disabled
+		void enable(bool value)
+		{
+			m_enabled = value;
+			if (!value)
+				drain(static_cast<std::size_t>(-1));
+		}
+
+		std::size_t budget() const noexcept
+		{
+			return m_budget;
+		}
+
+		void set_budget(std::size_t budget) noexcept
+		{
+			m_budget = budget;
+		}
+
+		std::size_t size()
+		{
+			std::lock_guard<std::mutex> guard(m_lock);
+			return m_queue.size();
+		}
+
+		bool push(void *, void (*)(void *)) noexcept;
+
+		// Release at most budget objects, return count of released objects
+		std::size_t drain(std::size_t);
+
+		std::size_t drain()
+		{
+			return drain(m_budget);
+		}
+
+		// Drain in a worker thread periodically, requires biased reference counts
+		void start_worker(std::size_t interval_ms);
+
+		void stop_worker();
+	};
+#endif
+
+/*
+* String Pool
+* Interned strings with the same content share one entry, entries are released with their last reference.
+* Each module has its own pool, extensions intern strings into the pool of host process once attached.
+*/
+	class string_pool final {
+	public:
+		struct entry {
+			std::atomic<std::size_t> refcount{1};
+			std::size_t hash;
+			std::string str;
+			string_pool *pool;
+
+			entry(std::size_t code, const std::string &s, string_pool *p) : hash(code), str(s), pool(p) {}
+		};
+
+	private:
+		std::mutex m_lock;
+		std::unordered_multimap<std::size_t, entry *> m_entries;
+	public:
+		string_pool() = default;
+
+		string_pool(const string_pool &) = delete;
+
+		// Pool of current module, never destroyed
+		static string_pool *local();
+
+		// Pool of current process
+		static string_pool *current();
+
+		// Return the entry with a new reference
+		entry *intern(const std::string &);
+
+		static void acquire(entry *ptr) noexcept
+		{
+			ptr->refcount.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		// The last reference is dropped with pool locked, so it never races with intern
+		static void release(entry *ptr) noexcept
+		{
+			std::size_t count = ptr->refcount.load(std::memory_order_relaxed);
+			while (count > 1)
+				if (ptr->refcount.compare_exchange_weak(count, count - 1, std::memory_order_acq_rel, std::memory_order_relaxed))
+					return;
+			ptr->pool->erase(ptr);
+		}
+
+		std::size_t size()
+		{
+			std::lock_guard<std::mutex> guard(m_lock);
+			return m_entries.size();
+		}
+
+	private:
+		void erase(entry *) noexcept;
+	};
+
+#ifdef COVSCRIPT_VAR_CYCLE_COLLECTOR
+/*
+* Cycle Collector
+* Containers of variables which survive a release are buffered as possible roots of garbage cycles.
+* Collection runs trial deletion over the containers reachable from the buffer: references between them
+* are subtracted, containers still referenced from elsewhere keep everything they reach alive and the rest
+* are cleared and released. Collection starts in process_context::poll_event after threshold
+* containers are allocated, or by calling collect.
+* Containers may be released on any thread, so the buffer and counters are guarded by a lock. Releasing
+* threads wait while a collection traces the containers, but the containers reachable from the buffer
+* must not be changed by other threads meanwhile.
+*/
+	struct cycle_report {
+		// Containers traced in the last collection
+		std::size_t scanned = 0;
+		// Containers released in the last collection
+		std::size_t reclaimed = 0;
+		// Released containers of each type
+		map_t<std::string, std::size_t> types;
+	};
+
+	class cycle_collector final {
+		mutable std::mutex m_lock;
+		set_t<void *> m_suspects;
+		std::atomic<std::size_t> m_allocated{0};
+		std::atomic<std::size_t> m_threshold{10000};
+		std::size_t m_reclaimed = 0;
+		std::atomic<bool> m_collecting{false};
+		cycle_report m_report;
+	public:
+		cycle_collector() = default;
+
+		cycle_collector(const cycle_collector &) = delete;
+
+		bool suspect(void *ptr) noexcept
+		{
+			try {
+				std::lock_guard<std::mutex> guard(m_lock);
+				m_suspects.insert(ptr);
+				return true;
+			}
+			catch (...) {
+				return false;
+			}
+		}
+
+		void forget(void *ptr) noexcept
+		{
+			std::lock_guard<std::mutex> guard(m_lock);
+			m_suspects.erase(ptr);
+		}
+
+		void allocated() noexcept
+		{
+			m_allocated.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		// Allocations of containers between collections, 0 disables automatic collection
+		std::size_t threshold() const noexcept
+		{
+			return m_threshold.load(std::memory_order_relaxed);
+		}
+
+		void set_threshold(std::size_t threshold) noexcept
+		{
+			m_threshold.store(threshold, std::memory_order_relaxed);
+		}
+
+		bool due() const noexcept
+		{
+			std::size_t limit = threshold();
+			return limit > 0 && m_allocated.load(std::memory_order_relaxed) >= limit && !m_collecting.load(std::memory_order_relaxed);
+		}
+
+		std::size_t suspects() const
+		{
+			std::lock_guard<std::mutex> guard(m_lock);
+			return m_suspects.size();
+		}
+
+		// Containers released by all collections
+		std::size_t total_reclaimed() const
+		{
+			std::lock_guard<std::mutex> guard(m_lock);
+			return m_reclaimed;
+		}
+
+		cycle_report last_report() const
+		{
+			std::lock_guard<std::mutex> guard(m_lock);
+			return m_report;
+		}
+
+		// Return count of released containers
+		std::size_t collect();
+	};
+#endif
+
+/*
+* Idle Release
+* Pools keep their free memory after a burst. Once no depot exchanged blocks with a magazine and no slab was
+* acquired for the idle period, process_context::poll_event returns free memory of pools to the system.
+* The clock is only read every poll_interval polls.
+*/
+	class idle_release final {
+		static constexpr std::size_t poll_interval = 1024;
+		std::chrono::steady_clock::duration m_period{};
+		std::chrono::steady_clock::time_point m_since;
+		std::size_t m_polls = 0;
+		std::size_t m_activity = 0;
+		bool m_released = true;
+	public:
+		// Zero disables release on idle
+		std::chrono::steady_clock::duration period() const noexcept
+		{
+			return m_period;
+		}
+
+		void set_period(std::chrono::steady_clock::duration period) noexcept
+		{
+			m_period = period;
+			m_polls = 0;
+		}
+
+		bool due() noexcept
+		{
+			return m_period.count() > 0 && ++m_polls >= poll_interval;
+		}
+
+		// Return bytes released
+		std::size_t poll(pool_allocator *pools)
+		{
+			m_polls = 0;
+			std::size_t activity = pools->heap()->acquired();
+			for (auto &stats: pools->statistics())
+				activity += stats.exchanges;
+			auto now = std::chrono::steady_clock::now();
+			if (activity != m_activity) {
+				m_activity = activity;
+				m_since = now;
+				m_released = false;
+			}
+			else if (!m_released && now - m_since >= m_period) {
+				m_released = true;
+				return pools->release_memory();
+			}
+			return 0;
+		}
+	};
+
 // Process Context
 	class process_context final {
 		std::atomic<bool> is_sigint_raised{};
 	public:
 // Exit code
 		int exit_code = 0;
+// Dense type IDs
+		type_registry type_ids;
+// Interned strings, the pool of each module outlives its process context
+		string_pool *symbols = string_pool::local();
+// Pools and slabs of small objects, shared with extensions, the allocator of each module outlives its process context
+		pool_allocator *pools = pool_allocator::local();
+// Proxies of variables created by a thread inside an arena scope are released in bulk at the end of the scope
+		using arena_scope = var_arena;
+#ifdef COVSCRIPT_VAR_STATISTICS
+// Allocation statistics, the registry of each module outlives its process context
+		statistics_registry *var_counters = statistics_registry::local();
+#endif
+
+		// Allocation statistics of cs::var, empty unless built with COVSCRIPT_VAR_STATISTICS
+		std::vector<var_statistics> get_var_statistics()
+		{
+#ifdef COVSCRIPT_VAR_STATISTICS
+			return var_counters->snapshot();
+#else
+			return {};
+#endif
+		}
+
+		// Usage of pool depots shared by all modules, save_profile of pools at exit to size them on the next start
+		std::vector<pool_statistics> get_pool_statistics()
+		{
+			return pools->statistics();
+		}
+
+// Byte budget of variables, the budget of each module outlives its process context
+		memory_budget *var_budget = memory_budget::local();
+
+// Release of free memory of pools after traffic peaks, polled by poll_event
+		idle_release pool_release;
+
+		// Return free memory of pools to the system now, return the number of bytes returned
+		std::size_t release_memory()
+		{
+			return pools->release_memory();
+		}
+#ifdef COVSCRIPT_VAR_DEFERRED_RELEASE
+// Deferred release of containers
+		release_queue var_release;
+#endif
+#ifdef COVSCRIPT_VAR_CYCLE_COLLECTOR
+// Collector of garbage cycles between containers
+		cycle_collector var_cycles;
+#endif
 // Event Handling
 		static bool on_process_exit_default_handler(void *);
 
@@ -81,6 +515,16 @@ namespace cs {
 				is_sigint_raised = false;
 				on_process_sigint.touch(nullptr);
 			}
+#ifdef COVSCRIPT_VAR_DEFERRED_RELEASE
+			if (var_release.enabled())
+				var_release.drain();
+#endif
+#ifdef COVSCRIPT_VAR_CYCLE_COLLECTOR
+			if (var_cycles.due())
+				var_cycles.collect();
+#endif
+			if (pool_release.due())
+				pool_release.poll(pools);
 		}
 
 		inline void raise_sigint()
@@ -111,6 +555,149 @@ namespace cs {
 	extern process_context this_process;
 	extern process_context *current_process;
 
+	/*
+	* Interned String
+	* Compared by address and hashed by the code computed on interning, which is the std::hash of the text.
+	* Strings interned in different pools, before an extension is attached, still compare equal by content.
+	* The empty string is not interned. Variables holding interned strings compare equal to variables
+	* holding std::string of the same text and hash alike, so either finds the other in cs::hash_map.
+	*/
+	class interned_string final {
+		friend class symbol_lookup;
+
+		using entry = string_pool::entry;
+		entry *m_entry = nullptr;
+
+		// Refer to an entry owned by the caller, which is never released by the last reference
+		explicit interned_string(entry *ptr) noexcept : m_entry(ptr)
+		{
+			string_pool::acquire(m_entry);
+		}
+
+	public:
+		interned_string() = default;
+
+		interned_string(const std::string &str) : m_entry(str.empty() ? nullptr : string_pool::current()->intern(str)) {}
+
+		interned_string(const char *str) : interned_string(std::string(str)) {}
+
+		interned_string(const interned_string &str) noexcept : m_entry(str.m_entry)
+		{
+			if (m_entry != nullptr)
+				string_pool::acquire(m_entry);
+		}
+
+		interned_string(interned_string &&str) noexcept : m_entry(str.m_entry)
+		{
+			str.m_entry = nullptr;
+		}
+
+		~interned_string()
+		{
+			if (m_entry != nullptr)
+				string_pool::release(m_entry);
+		}
+
+		interned_string &operator=(interned_string str) noexcept
+		{
+			std::swap(m_entry, str.m_entry);
+			return *this;
+		}
+
+		const std::string &str() const noexcept
+		{
+			static const std::string empty;
+			return m_entry != nullptr ? m_entry->str : empty;
+		}
+
+		operator const std::string &() const noexcept
+		{
+			return str();
+		}
+
+		bool empty() const noexcept
+		{
+			return m_entry == nullptr;
+		}
+
+		std::size_t hash() const noexcept
+		{
+			static const std::size_t empty = std::hash<std::string>()(std::string());
+			return m_entry != nullptr ? m_entry->hash : empty;
+		}
+
+		bool operator==(const interned_string &str) const noexcept
+		{
+			if (m_entry == str.m_entry)
+				return true;
+			if (m_entry == nullptr || str.m_entry == nullptr || m_entry->pool == str.m_entry->pool)
+				return false;
+			return m_entry->hash == str.m_entry->hash && m_entry->str == str.m_entry->str;
+		}
+
+		bool operator!=(const interned_string &str) const noexcept
+		{
+			return !(*this == str);
+		}
+	};
+}
+
+namespace std {
+	template<>
+	struct hash<cs::interned_string> {
+		std::size_t operator()(const cs::interned_string &str) const noexcept
+		{
+			return str.hash();
+		}
+	};
+}
+
+namespace cs {
+	/*
+	* Key for lookups by content, which neither locks nor grows the string pool.
+	* Its entry belongs to no pool, so it compares equal to interned strings by content.
+	*/
+	class symbol_lookup final {
+		string_pool::entry m_entry;
+		interned_string m_key;
+	public:
+		explicit symbol_lookup(const std::string &str) : m_entry(std::hash<std::string>()(str), str, nullptr)
+		{
+			if (!str.empty())
+				m_key = interned_string(&m_entry);
+		}
+
+		symbol_lookup(const symbol_lookup &) = delete;
+
+		operator const interned_string &() const noexcept
+		{
+			return m_key;
+		}
+	};
+}
+
+namespace cs_impl {
+	template<>
+	struct to_string_writer<cs::interned_string> {
+		static void write(std::string &out, const cs::interned_string &val)
+		{
+			out += val.str();
+		}
+	};
+
+	template<>
+	struct text_type<cs::interned_string> {
+		static constexpr bool value = true;
+
+		static const std::string *get(const cs::interned_string &str) noexcept
+		{
+			return &str.str();
+		}
+	};
+}
+
+namespace cs {
+
 	// Callable and Function
 	class callable final {
 	public:
@@ -169,7 +756,7 @@ namespace cs {
 	template<typename... ArgsT>
 	static var invoke(const var &func, ArgsT &&... _args)
 	{
-		if (func.type() == typeid(callable)) {
+		if (func.is_type_of<callable>()) {
 			vector args{std::forward<ArgsT>(_args)...};
 			return func.const_val<callable>().call(args);
 		}
@@ -198,6 +785,12 @@ namespace cs {
 		domain_ref(domain_type *ptr) : domain(ptr) {}
 	};
 
+	/*
+	* Variable ID
+	* Lookups use the interned name. get_id and the constant std::string conversion read the name,
+	* set_id replaces it. The mutable std::string conversion hands out a copy of the name, which is
+	* interned again at the next lookup whenever it differs, so such ids pay a string comparison per lookup.
+	*/
 	class var_id final {
 		friend class domain_type;
 
@@ -205,53 +798,82 @@ namespace cs {
 
 		mutable std::size_t m_domain_id = 0, m_slot_id = 0;
 		mutable std::shared_ptr<domain_ref> m_ref;
-		std::string m_id;
+		mutable interned_string m_id;
+		// Name handed out for writing in place, if any
+		mutable std::unique_ptr<std::string> m_name;
+
+		// Intern the name again if it was written in place, the cached slot belongs to the old name
+		void refresh() const
+		{
+			if (m_name != nullptr && *m_name != m_id.str()) {
+				m_id = *m_name;
+				m_ref.reset();
+			}
+		}
+
 	public:
 		var_id() = delete;
 
-		var_id(std::string name) : m_id(std::move(name)) {}
+		var_id(std::string name) : m_id(name) {}
 
-		var_id(const var_id &) = default;
+		var_id(const var_id &id) : m_domain_id(id.m_domain_id), m_slot_id(id.m_slot_id), m_ref(id.m_ref), m_id(id.m_id),
+			m_name(id.m_name != nullptr ? new std::string(*id.m_name) : nullptr) {}
 
 		var_id(var_id &&) noexcept = default;
 
-		var_id &operator=(const var_id &) = default;
+		var_id &operator=(const var_id &id)
+		{
+			if (this != &id)
+				*this = var_id(id);
+			return *this;
+		}
 
 		var_id &operator=(var_id &&) = default;
 
 		inline void set_id(const std::string &id)
 		{
 			m_id = id;
+			if (m_name != nullptr)
+				*m_name = id;
 		}
 
 		inline const std::string &get_id() const noexcept
 		{
-			return m_id;
+			return m_name != nullptr ? *m_name : m_id.str();
 		}
 
-		inline operator std::string &() noexcept
+		inline const interned_string &get_symbol() const
 		{
+			refresh();
 			return m_id;
 		}
 
 		inline operator const std::string &() const noexcept
 		{
-			return m_id;
+			return get_id();
+		}
+
+		inline operator std::string &()
+		{
+			if (m_name == nullptr)
+				m_name.reset(new std::string(m_id.str()));
+			return *m_name;
 		}
 	};
 
 	class domain_type final {
-		map_t<std::string, std::size_t> m_reflect;
+		map_t<interned_string, std::size_t> m_reflect;
 		std::shared_ptr<domain_ref> m_ref;
 		std::vector<var> m_slot;
 		bool optimize = false;
 
-		inline std::size_t get_slot_id(const std::string &name) const
+		inline std::size_t get_slot_id(const interned_string &name) const
 		{
-			if (m_reflect.count(name) > 0)
-				return m_reflect.at(name);
+			auto it = m_reflect.find(name);
+			if (it != m_reflect.end())
+				return it->second;
 			else
-				throw runtime_error("Use of undefined variable \"" + name + "\".");
+				throw runtime_error("Use of undefined variable \"" + name.str() + "\".");
 		}
 
 	public:
@@ -285,32 +907,36 @@ namespace cs {
 
 		inline bool consistence(const var_id &id) const noexcept
 		{
+			id.refresh();
 			return id.m_ref == m_ref;
 		}
 
 		inline bool exist(const std::string &name) const noexcept
 		{
-			return m_reflect.count(name) > 0;
+			return m_reflect.count(symbol_lookup(name)) > 0;
 		}
 
 		inline bool exist(const var_id &id) const noexcept
 		{
+			id.refresh();
 			return m_reflect.count(id.m_id) > 0;
 		}
 
 		domain_type &add_var(const std::string &name, const var &val)
 		{
-			if (m_reflect.count(name) == 0) {
+			auto it = m_reflect.find(symbol_lookup(name));
+			if (it == m_reflect.end()) {
 				m_slot.push_back(val);
-				m_reflect.emplace(name, m_slot.size() - 1);
+				m_reflect.emplace(interned_string(name), m_slot.size() - 1);
 			}
 			else
-				m_slot[m_reflect[name]] = val;
+				m_slot[it->second] = val;
 			return *this;
 		}
 
 		domain_type &add_var(const var_id &id, const var &val)
 		{
+			id.refresh();
 			if (m_reflect.count(id.m_id) == 0) {
 				m_slot.push_back(val);
 				m_reflect.emplace(id.m_id, m_slot.size() - 1);
@@ -329,9 +955,10 @@ namespace cs {
 
 		bool add_var_optimal(const std::string &name, const var &val, bool override = false)
 		{
-			if (m_reflect.count(name) > 0) {
+			auto it = m_reflect.find(symbol_lookup(name));
+			if (it != m_reflect.end()) {
 				if (optimize) {
-					m_slot[m_reflect.at(name)] = val;
+					m_slot[it->second] = val;
 					return true;
 				}
 				else if (override) {
@@ -349,6 +976,7 @@ namespace cs {
 
 		bool add_var_optimal(const var_id &id, const var &val, bool override = false)
 		{
+			id.refresh();
 			if (id.m_ref == m_ref) {
 				if (optimize) {
 					m_slot[id.m_slot_id] = val;
@@ -369,6 +997,7 @@ namespace cs {
 
 		var &get_var(const var_id &id)
 		{
+			id.refresh();
 			if (id.m_ref != m_ref) {
 				id.m_slot_id = get_slot_id(id.m_id);
 				id.m_ref = m_ref;
@@ -378,6 +1007,7 @@ namespace cs {
 
 		const var &get_var(const var_id &id) const
 		{
+			id.refresh();
 			if (id.m_ref != m_ref) {
 				id.m_slot_id = get_slot_id(id.m_id);
 				id.m_ref = m_ref;
@@ -387,22 +1017,17 @@ namespace cs {
 
 		var &get_var(const std::string &name)
 		{
-			if (m_reflect.count(name) > 0)
-				return m_slot[m_reflect.at(name)];
-			else
-				throw runtime_error("Use of undefined variable \"" + name + "\".");
+			return m_slot[get_slot_id(symbol_lookup(name))];
 		}
 
 		const var &get_var(const std::string &name) const
 		{
-			if (m_reflect.count(name) > 0)
-				return m_slot[m_reflect.at(name)];
-			else
-				throw runtime_error("Use of undefined variable \"" + name + "\".");
+			return m_slot[get_slot_id(symbol_lookup(name))];
 		}
 
 		var &get_var_no_check(const var_id &id) noexcept
 		{
+			id.refresh();
 			if (id.m_ref != m_ref) {
 				id.m_slot_id = m_reflect.at(id.m_id);
 				id.m_ref = m_ref;
@@ -412,6 +1037,7 @@ namespace cs {
 
 		const var &get_var_no_check(const var_id &id) const noexcept
 		{
+			id.refresh();
 			if (id.m_ref != m_ref) {
 				id.m_slot_id = m_reflect.at(id.m_id);
 				id.m_ref = m_ref;
@@ -421,6 +1047,7 @@ namespace cs {
 
 		var &get_var_no_check(const var_id &id, std::size_t domain_id) noexcept
 		{
+			id.refresh();
 			id.m_domain_id = domain_id;
 			if (id.m_ref != m_ref) {
 				id.m_slot_id = m_reflect.at(id.m_id);
@@ -431,12 +1058,12 @@ namespace cs {
 
 		inline var &get_var_no_check(const std::string &name) noexcept
 		{
-			return m_slot[m_reflect.at(name)];
+			return m_slot[m_reflect.at(symbol_lookup(name))];
 		}
 
 		inline const var &get_var_no_check(const std::string &name) const noexcept
 		{
-			return m_slot[m_reflect.at(name)];
+			return m_slot[m_reflect.at(symbol_lookup(name))];
 		}
 
 		inline auto begin() const
@@ -575,10 +1202,41 @@ namespace cs {
 
 	namespace dll_resources {
 		constexpr char dll_compatible_check[] = "__CS_ABI_COMPATIBLE__";
+		constexpr char dll_layout_check[] = "__CS_ABI_LAYOUT__";
 		constexpr char dll_main_entrance[] = "__CS_EXTENSION_MAIN__";
 
+		/*
+		* Build options changing the layout of cs::any and the pools, extensions
+		* must be built with exactly the same set as the interpreter.
+		*/
+		constexpr int abi_layout()
+		{
+			return 0
+#ifdef COVSCRIPT_VAR_BIASED_REFCOUNT
+			       | 0x01
+#endif
+#ifdef COVSCRIPT_VAR_COMPACT
+			       | 0x02
+#endif
+#ifdef COVSCRIPT_VAR_STATISTICS
+			       | 0x04
+#endif
+#ifdef COVSCRIPT_VAR_DEFERRED_RELEASE
+			       | 0x08
+#endif
+#ifdef COVSCRIPT_VAR_CYCLE_COLLECTOR
+			       | 0x10
+#endif
+#ifdef COVSCRIPT_SLAB_HUGEPAGE
+			       | 0x20
+#endif
+			       ;
+		}
+
 		typedef int(*dll_compatible_check_t)();
 
+		typedef int(*dll_layout_check_t)();
+
 		typedef void(*dll_main_entrance_t)(name_space *, process_context *);
 	}
 
@@ -605,6 +1263,11 @@ namespace cs {
 			if (dll_check == nullptr || truncate(dll_check(), 4) != truncate(COVSCRIPT_ABI_VERSION, 4))
 				throw runtime_error("Incompatible Covariant Script Extension.(Target: " + std::to_string(dll_check()) +
 				                    ", Current: " + std::to_string(COVSCRIPT_ABI_VERSION) + ")");
+			dll_layout_check_t layout_check = reinterpret_cast<dll_layout_check_t>(dll->get_address(dll_layout_check));
+			if (layout_check == nullptr || layout_check() != abi_layout())
+				throw runtime_error("Incompatible Covariant Script Extension build options.(Target: " +
+				                    (layout_check == nullptr ? std::string("unknown") : std::to_string(layout_check())) +
+				                    ", Current: " + std::to_string(abi_layout()) + ")");
 			dll_main_entrance_t dll_main = reinterpret_cast<dll_main_entrance_t>(dll->get_address(dll_main_entrance));
 			if (dll_main != nullptr) {
 				dll_main(this, current_process);
@@ -112,6 +112,9 @@
 namespace cs_impl {
 	class any;
 
+	template<typename T>
+	class any_handle;
+
 	class cni;
 }
 namespace cs {
@@ -119,10 +122,13 @@ namespace cs {
 
 	class name_space;
 
+	class cycle_collector;
+
 	template<typename _kT, typename _vT> using map_t = std::unordered_map<_kT, _vT>;
 	template<typename _Tp> using set_t = std::unordered_set<_Tp>;
 
 	using var = cs_impl::any;
+	template<typename T> using var_handle = cs_impl::any_handle<T>;
 	using boolean = bool;
 	using string = std::string;
 	using list = std::list<var>;
@@ -27,8 +27,43 @@
 #include <covscript/import/mozart/traits.hpp>
 
 namespace cs_impl {
-// Name Demangle
-	std::string cxx_demangle(const char *);
+// Name Demangle, results are cached and never released
+	const std::string &cxx_demangle(const char *);
+
+/*
+* Dense Type ID
+* Each type receives an integer ID from the registry of current process the first time it is used,
+* so type checks between extensions do not need to compare type_info objects.
+* Every extension caches the IDs in its own slots, ID 0 means the slot is not resolved yet.
+*/
+	struct type_id_slot {
+		std::atomic<std::size_t> id{0};
+		type_id_slot *next = nullptr;
+	};
+
+	std::size_t resolve_type_id(type_id_slot &, const std::type_info &);
+
+	// Forget cached IDs, called when an extension switches to the context of host.
+	void reset_type_ids();
+
+	template<typename T>
+	struct type_id_holder {
+		static type_id_slot slot;
+	};
+
+	template<typename T> type_id_slot type_id_holder<T>::slot;
+
+	inline std::size_t get_type_id(type_id_slot &slot, const std::type_info &info)
+	{
+		std::size_t id = slot.id.load(std::memory_order_relaxed);
+		return id != 0 ? id : resolve_type_id(slot, info);
+	}
+
+	template<typename T>
+	inline std::size_t get_type_id()
+	{
+		return get_type_id(type_id_holder<T>::slot, typeid(T));
+	}
 
 // Type support auto-detection(SFINAE)
 // Compare
@@ -72,6 +107,30 @@ namespace cs_impl {
 		}
 	};
 
+	/*
+	* Types holding text, which compare equal to each other by content.
+	* Their hash codes must match std::hash<std::string> of the text.
+	*/
+	template<typename T>
+	struct text_type {
+		static constexpr bool value = false;
+
+		static const std::string *get(const T &) noexcept
+		{
+			return nullptr;
+		}
+	};
+
+	template<>
+	struct text_type<std::string> {
+		static constexpr bool value = true;
+
+		static const std::string *get(const std::string &str) noexcept
+		{
+			return &str;
+		}
+	};
+
 // To String
 	template<typename _Tp>
 	class to_string_helper {
@@ -226,6 +285,124 @@ namespace cs_impl {
 		return type::hash(val);
 	}
 
+	/*
+	* Hash caching
+	* Hash codes of these types are kept by constant variables, and are also used to tell unequal constants
+	* apart. Specialize it for your own types which are expensive to hash and compare, equality of them must
+	* be reflexive.
+	*/
+	template<typename T>
+	struct is_hash_cached {
+		static constexpr bool value = false;
+	};
+
+	template<>
+	struct is_hash_cached<std::string> {
+		static constexpr bool value = true;
+	};
+
+	/*
+	* Streaming to string
+	* Appends text of a value to a string, so nested values are printed into one buffer.
+	* Specialize it for your own types to avoid temporary strings, otherwise the text is taken from to_string.
+	*/
+	template<typename T, typename = void>
+	struct to_string_writer {
+		static void write(std::string &out, const T &val)
+		{
+			out += cs_impl::to_string(val);
+		}
+	};
+
+	template<typename T>
+	using is_char_type = std::integral_constant<bool, std::is_same<T, char>::value || std::is_same<T, signed char>::value || std::is_same<T, unsigned char>::value || std::is_same<T, wchar_t>::value || std::is_same<T, char16_t>::value || std::is_same<T, char32_t>::value>;
+
+	// Integers are formatted in place, characters and booleans are left to to_string
+	template<typename T>
+	struct to_string_writer<T, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value && !is_char_type<T>::value>::type> {
+		using unsigned_type = typename std::make_unsigned<T>::type;
+
+		static bool is_negative(T val, std::true_type)
+		{
+			return val < 0;
+		}
+
+		static bool is_negative(T, std::false_type)
+		{
+			return false;
+		}
+
+		static void write(std::string &out, T val)
+		{
+			char buff[std::numeric_limits<unsigned_type>::digits10 + 2];
+			char *end = buff + sizeof(buff), *ptr = end;
+			unsigned_type num = static_cast<unsigned_type>(val);
+			bool negative = is_negative(val, std::is_signed<T>());
+			if (negative)
+				num = unsigned_type(0) - num;
+			// Two digits at a time
+			static constexpr char digits[] = "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+			                                 "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+			                                 "8081828384858687888990919293949596979899";
+			while (num >= 100) {
+				std::size_t idx = static_cast<std::size_t>(num % 100) * 2;
+				num /= 100;
+				*--ptr = digits[idx + 1];
+				*--ptr = digits[idx];
+			}
+			if (num >= 10) {
+				std::size_t idx = static_cast<std::size_t>(num) * 2;
+				*--ptr = digits[idx + 1];
+				*--ptr = digits[idx];
+			}
+			else
+				*--ptr = static_cast<char>('0' + num);
+			if (negative)
+				*--ptr = '-';
+			out.append(ptr, end - ptr);
+		}
+	};
+
+	// Same format as std::to_string
+	template<typename T>
+	struct to_string_writer<T, typename std::enable_if<std::is_floating_point<T>::value>::type> {
+		static int format(char *buff, std::size_t size, double val)
+		{
+			return std::snprintf(buff, size, "%f", val);
+		}
+
+		static int format(char *buff, std::size_t size, long double val)
+		{
+			return std::snprintf(buff, size, "%Lf", val);
+		}
+
+		static void write(std::string &out, T val)
+		{
+			char buff[64];
+			int size = format(buff, sizeof(buff), val);
+			if (size >= 0 && static_cast<std::size_t>(size) < sizeof(buff))
+				out.append(buff, size);
+			else
+				out += std::to_string(val);
+		}
+	};
+
+	template<>
+	struct to_string_writer<std::string> {
+		static void write(std::string &out, const std::string &val)
+		{
+			out += val;
+		}
+	};
+
+	template<>
+	struct to_string_writer<bool> {
+		static void write(std::string &out, bool val)
+		{
+			out += val ? "true" : "false";
+		}
+	};
+
 	template<typename T>
 	static void detach(T &val)
 	{
@@ -238,11 +415,169 @@ namespace cs_impl {
 		return typeid(T).name();
 	}
 
+/*
+* Allocation Statistics
+* Define COVSCRIPT_VAR_STATISTICS to count live objects, allocations and bytes of each held type.
+* Counters belong to the process context and are keyed by demangled type name, every type caches
+* its counter in a slot like dense type IDs.
+*/
+#ifdef COVSCRIPT_VAR_STATISTICS
+	struct statistics_counter {
+		std::atomic<std::size_t> live{0};
+		std::atomic<std::size_t> total{0};
+		std::atomic<std::size_t> bytes{0};
+	};
+
+	struct statistics_slot {
+		std::atomic<statistics_counter *> counter{nullptr};
+		statistics_slot *next = nullptr;
+	};
+
+	statistics_counter &resolve_statistics(statistics_slot &, const char *);
+
+	// Forget cached counters and hand over counts of extension to the host
+	void reset_statistics();
+
+	template<typename T>
+	struct statistics_holder {
+		static statistics_slot slot;
+	};
+
+	template<typename T> statistics_slot statistics_holder<T>::slot;
+
+	template<typename T>
+	statistics_counter &get_statistics()
+	{
+		statistics_counter *counter = statistics_holder<T>::slot.counter.load(std::memory_order_acquire);
+		return counter != nullptr ? *counter : resolve_statistics(statistics_holder<T>::slot, get_name_of_type<T>());
+	}
+
+	template<typename T>
+	inline void count_alloc(std::size_t bytes)
+	{
+		statistics_counter &counter = get_statistics<T>();
+		counter.live.fetch_add(1, std::memory_order_relaxed);
+		counter.total.fetch_add(1, std::memory_order_relaxed);
+		counter.bytes.fetch_add(bytes, std::memory_order_relaxed);
+	}
+
+	template<typename T>
+	inline void count_free(std::size_t bytes) noexcept
+	{
+		statistics_counter &counter = get_statistics<T>();
+		counter.live.fetch_sub(1, std::memory_order_relaxed);
+		counter.bytes.fetch_sub(bytes, std::memory_order_relaxed);
+	}
+#else
+
+	inline void reset_statistics() noexcept {}
+
+	template<typename T>
+	inline void count_alloc(std::size_t) noexcept {}
+
+	template<typename T>
+	inline void count_free(std::size_t) noexcept {}
+
+#endif
+
+/*
+* Containers of variables
+* Releasing them may release a large graph of variables, so they are released later in deferred release mode.
+* Specialize it for your own types holding variables.
+*/
+	template<typename T>
+	struct is_var_container {
+		static constexpr bool value = false;
+	};
+
+	template<>
+	struct is_var_container<cs::array> {
+		static constexpr bool value = true;
+	};
+
+	template<>
+	struct is_var_container<cs::list> {
+		static constexpr bool value = true;
+	};
+
+	template<>
+	struct is_var_container<std::vector<any>> {
+		static constexpr bool value = true;
+	};
+
+	template<>
+	struct is_var_container<cs::pair> {
+		static constexpr bool value = true;
+	};
+
+	template<>
+	struct is_var_container<cs::hash_set> {
+		static constexpr bool value = true;
+	};
+
+	template<>
+	struct is_var_container<cs::hash_map> {
+		static constexpr bool value = true;
+	};
+
+/*
+* Tracing of variables held by a payload, used by the cycle collector.
+* trace visits every variable held directly by the payload, clear releases all of them.
+* Specialize it for your own types holding variables, as var_container_tracer does for containers.
+*/
+	template<typename T>
+	struct var_tracer {
+		static constexpr bool value = false;
+
+		static void trace(const T &, void (*)(const any &, void *), void *) {}
+
+		static void clear(T &) {}
+	};
+
+	template<typename T>
+	struct var_container_tracer {
+		static constexpr bool value = true;
+
+		static void trace(const T &dat, void (*visit)(const any &, void *), void *ctx)
+		{
+			for (auto &it: dat)
+				visit(it, ctx);
+		}
+
+		static void clear(T &dat)
+		{
+			T tmp;
+			std::swap(tmp, dat);
+		}
+	};
+
+#ifdef COVSCRIPT_VAR_CYCLE_COLLECTOR
+#ifdef COVSCRIPT_VAR_BIASED_REFCOUNT
+#error Cycle collector of cs::var requires plain reference counts.
+#endif
+	// Buffer a container surviving a release as possible root of garbage cycles
+	bool cycle_suspect(void *) noexcept;
+
+	// Remove a released container from the buffer
+	void cycle_forget(void *) noexcept;
+
+	// Count allocations of containers for the collection threshold
+	void cycle_allocated() noexcept;
+#endif
+
+#ifdef COVSCRIPT_VAR_DEFERRED_RELEASE
+	// Queue a proxy in the release queue of current process, return false if deferred release is disabled
+	bool defer_release(void *, void (*)(void *)) noexcept;
+#endif
+
 	template<typename T>
 	struct to_string_if<T, false> {
 		static std::string to_string(const T &)
 		{
-			return "[" + cxx_demangle(get_name_of_type<T>()) + "]";
+			std::string str = cxx_demangle(get_name_of_type<T>());
+			str.insert(str.begin(), '[');
+			str += ']';
+			return str;
 		}
 	};
 
@@ -296,239 +631,1710 @@ namespace cs_impl {
 // Be careful when you adjust the buffer size.
 	constexpr std::size_t default_allocate_buffer_size = 64;
 	constexpr std::size_t default_allocate_buffer_multiplier = 8;
-	template<typename T> using default_allocator_provider = std::allocator<T>;
-	template<typename T> using default_allocator = cs::allocator_type<T, default_allocate_buffer_size, default_allocator_provider>;
+	template<typename T> using default_allocator_provider = cs::slab_provider<T>;
+	template<typename T> using default_allocator = cs::slab_allocator<T, default_allocate_buffer_size>;
+// Holders up to default_block_granularity*default_block_classes bytes share one allocation with the proxy.
+	constexpr std::size_t default_block_granularity = 16;
+	constexpr std::size_t default_block_classes = 8;
+
+	/*
+	* Reference Count Policies
+	* refcount_plain is not thread safe and is used by default.
+	* refcount_biased keeps a non-atomic count for the thread which created the variable and an atomic count
+	* for other threads, so variables can be shared between threads. Define COVSCRIPT_VAR_BIASED_REFCOUNT to use it,
+	* the host and all extensions must be built with the same policy.
+	*/
+	class refcount_plain final {
+		// The count lives above flags_bits flag bits of the owner
+		static constexpr unsigned flags_bits = 20;
+		static constexpr std::uint64_t count_unit = std::uint64_t(1) << flags_bits;
+		static constexpr std::uint64_t flags_mask = count_unit - 1;
+
+		std::uint64_t m_word = count_unit;
+	public:
+		// Whether objects may be referenced from more than one thread
+		static constexpr bool concurrent = false;
+
+		static void poll() noexcept {}
+
+		void increase() noexcept
+		{
+			m_word += count_unit;
+		}
+
+		// Return true if the last reference is released
+		bool decrease(void *, void (*)(void *)) noexcept
+		{
+			return ((m_word -= count_unit) >> flags_bits) == 0;
+		}
+
+		bool unique() const noexcept
+		{
+			return (m_word >> flags_bits) == 1;
+		}
+
+		std::size_t count() const noexcept
+		{
+			return static_cast<std::size_t>(m_word >> flags_bits);
+		}
+
+		// Flags stored by the owner of reference count
+		unsigned flags() const noexcept
+		{
+			return static_cast<unsigned>(m_word & flags_mask);
+		}
+
+		void set_flags(unsigned flags) noexcept
+		{
+			m_word = (m_word & ~flags_mask) | flags;
+		}
+	};
+
+	class refcount_biased;
+
+	/*
+	* Owner of biased reference counts, one for each thread.
+	* When other threads release more references than they acquired, the object is queued here
+	* and the owning thread merges its biased count later. After the thread exits, its owner is kept for
+	* reuse by new threads and until then the releasing threads merge the counts instead.
+	*/
+	class biased_owner final {
+		friend class refcount_biased;
+
+		struct entry {
+			refcount_biased *refcount;
+			void *object;
+			void (*release)(void *);
+		};
+
+		std::mutex m_lock;
+		std::vector<entry> m_queue;
+		std::atomic<bool> m_pending{false};
+		std::atomic<bool> m_alive{true};
+
+		static biased_owner *create();
+
+		static void release_all(std::vector<entry> &);
+
+	public:
+		static biased_owner *current()
+		{
+			static thread_local biased_owner *owner = nullptr;
+			if (owner == nullptr)
+				owner = create();
+			return owner;
+		}
+
+		// Merge counts queued by other threads, must be called by the owning thread
+		void collect()
+		{
+			std::vector<entry> queue;
+			{
+				std::lock_guard<std::mutex> guard(m_lock);
+				m_pending = false;
+				std::swap(queue, m_queue);
+			}
+			release_all(queue);
+		}
+
+		// Called when the owning thread exits
+		void retire();
+	};
+
+	class refcount_biased final {
+		friend class biased_owner;
+
+		static constexpr std::intptr_t merged_flag = 1;
+		static constexpr std::intptr_t queued_flag = 2;
+		static constexpr std::intptr_t count_unit = 4;
+
+		std::atomic<biased_owner *> m_owner;
+		std::size_t m_biased = 1;
+		std::atomic<std::intptr_t> m_shared{0};
+		// Kept apart from the counts, which may be updated by other threads
+		std::uint32_t m_flags = 0;
+
+	public:
+		static constexpr bool concurrent = true;
+
+	private:
+		static std::intptr_t count_of(std::intptr_t val) noexcept
+		{
+			return (val - (val & (count_unit - 1))) / count_unit;
+		}
+
+		bool is_owner(biased_owner *owner) const noexcept
+		{
+			return m_owner.load(std::memory_order_relaxed) == owner && owner->m_alive.load(std::memory_order_relaxed);
+		}
+
+		// Fold the biased count into the shared count, only the owner or a releasing thread of dead owner may do this
+		bool merge() noexcept
+		{
+			std::intptr_t biased = static_cast<std::intptr_t>(m_biased);
+			m_biased = 0;
+			m_owner.store(nullptr, std::memory_order_relaxed);
+			std::intptr_t old = m_shared.fetch_add(biased * count_unit | merged_flag, std::memory_order_acq_rel);
+			return !(old & queued_flag) && count_of(old) + biased == 0;
+		}
+
+		// Resolve a queued object, return true if it should be released
+		bool dequeue() noexcept
+		{
+			if (!(m_shared.load(std::memory_order_acquire) & merged_flag))
+				merge();
+			std::intptr_t old = m_shared.fetch_and(~queued_flag, std::memory_order_acq_rel);
+			return count_of(old) == 0;
+		}
+
+		// Hand a queued object to its owner, the queued flag keeps it alive until it is resolved
+		bool enqueue(void *object, void (*release)(void *))
+		{
+			biased_owner *owner = m_owner.load(std::memory_order_relaxed);
+			if (owner != nullptr) {
+				std::lock_guard<std::mutex> guard(owner->m_lock);
+				if (owner->m_alive) {
+					owner->m_queue.push_back({this, object, release});
+					owner->m_pending = true;
+					return false;
+				}
+				return dequeue();
+			}
+			return dequeue();
+		}
+
+	public:
+		refcount_biased() : m_owner(biased_owner::current()) {}
+
+		static void poll()
+		{
+			biased_owner *owner = biased_owner::current();
+			if (owner->m_pending.load(std::memory_order_relaxed))
+				owner->collect();
+		}
+
+		void increase() noexcept
+		{
+			if (is_owner(biased_owner::current()))
+				++m_biased;
+			else
+				m_shared.fetch_add(count_unit, std::memory_order_relaxed);
+		}
+
+		// Return true if the last reference is released
+		bool decrease(void *object, void (*release)(void *))
+		{
+			if (is_owner(biased_owner::current()))
+				return --m_biased == 0 && merge();
+			// The first release below zero marks the object as queued in the same step
+			std::intptr_t old = m_shared.load(std::memory_order_relaxed), val = 0;
+			do {
+				val = old - count_unit;
+				if (!(old & (merged_flag | queued_flag)) && count_of(old) < 1)
+					val |= queued_flag;
+			}
+			while (!m_shared.compare_exchange_weak(old, val, std::memory_order_acq_rel, std::memory_order_relaxed));
+			if (old & merged_flag)
+				return count_of(old) == 1 && !(old & queued_flag);
+			else if (val & ~old & queued_flag)
+				return enqueue(object, release);
+			else
+				return false;
+		}
+
+		bool unique() const noexcept
+		{
+			std::intptr_t shared = m_shared.load(std::memory_order_acquire);
+			if (shared & merged_flag)
+				return count_of(shared) == 1;
+			else
+				return is_owner(biased_owner::current()) && static_cast<std::intptr_t>(m_biased) + count_of(shared) == 1;
+		}
+
+		unsigned flags() const noexcept
+		{
+			return m_flags;
+		}
+
+		void set_flags(unsigned flags) noexcept
+		{
+			m_flags = static_cast<std::uint32_t>(flags);
+		}
+	};
+
+	inline void biased_owner::release_all(std::vector<entry> &queue)
+	{
+		for (auto &it: queue)
+			if (it.refcount->dequeue())
+				it.release(it.object);
+	}
+
+#ifdef COVSCRIPT_VAR_BIASED_REFCOUNT
+	using default_refcount = refcount_biased;
+#else
+	using default_refcount = refcount_plain;
+#endif
 
 	class any final {
-		class baseHolder {
-		public:
-			baseHolder() = default;
+		friend class cs::cycle_collector;
+
+		template<typename>
+		friend class any_handle;
+
+		struct proxy;
+
+		/*
+		* Operation table of held type
+		* Generated at compile time for each type, proxies refer to the table of their payload
+		* instead of calling through a vptr of the holder.
+		*/
+		struct operation_table {
+			const std::type_info *type;
+
+			type_id_slot *type_id;
+
+			// Allocate a proxy block suitable for held type
+			proxy *(*alloc)(short);
+
+			// Size of the holder
+			std::size_t size;
+
+			bool deferred;
+
+			bool traced;
+
+			bool cache_hash;
+
+			void (*trace)(const void *, void (*)(const any &, void *), void *);
+
+			void (*clear)(void *);
+
+			proxy *(*duplicate)(const void *);
+
+			void *(*duplicate_to)(const void *, void *, std::size_t);
+
+			void *(*relocate)(void *, void *, std::size_t);
+
+			bool (*compare)(const void *, const void *);
+
+			// Text held by the payload, nullptr for types other than text types
+			const std::string *(*text)(const void *);
+
+			long (*to_integer)(const void *);
+
+			void (*to_string)(const void *, std::string &);
+
+			std::size_t (*hash)(const void *);
+
+			void (*detach)(void *);
+
+			void (*destroy)(void *) noexcept;
+
+			void (*kill)(void *) noexcept;
+
+			cs::namespace_t &(*get_ext)();
+
+			const char *(*get_type_name)();
+
+			std::size_t id() const
+			{
+				return get_type_id(*type_id, *type);
+			}
+
+			template<typename T>
+			bool is_type_of() const
+			{
+				return this == &holder<T>::ops || id() == get_type_id<T>();
+			}
+
+			bool is_same_type(const operation_table *obj) const
+			{
+				return this == obj || id() == obj->id();
+			}
+		};
+
+		template<typename T>
+		class holder {
+		protected:
+			T mDat;
+		public:
+			static default_allocator<holder<T>> allocator;
+
+			// Holders allocated separately inside of an arena are taken from the arena as well
+			static constexpr bool in_arena = sizeof(holder<T>) <= cs::slab_heap::max_size && alignof(holder<T>) <= alignof(std::max_align_t);
+			static constexpr std::size_t arena_size = (sizeof(holder<T>) + alignof(std::max_align_t) - 1) / alignof(std::max_align_t) * alignof(std::max_align_t);
+
+			/*
+			* Construct a holder in the buffer of proxy block if it fits,
+			* otherwise allocate it from the innermost arena or the pool.
+			*/
+			template<typename...ArgsT>
+			static holder<T> *create(void *buffer, std::size_t capacity, ArgsT &&...args)
+			{
+				holder<T> *ptr = nullptr;
+				cs::var_arena *arena = nullptr;
+				if (block_helper<holder<T>>::fits(capacity))
+					ptr = ::new(buffer) holder<T>(std::forward<ArgsT>(args)...);
+				else if (in_arena && (arena = cs::var_arena::current()) != nullptr) {
+					void *block = arena->allocate(arena_size);
+					try {
+						ptr = ::new(block) holder<T>(std::forward<ArgsT>(args)...);
+					}
+					catch (...) {
+						cs::var_arena::release(block);
+						throw;
+					}
+				}
+				else {
+					cs::memory_budget::charge(sizeof(holder<T>));
+					try {
+						ptr = allocator.alloc(std::forward<ArgsT>(args)...);
+					}
+					catch (...) {
+						cs::memory_budget::refund(sizeof(holder<T>));
+						throw;
+					}
+				}
+				count_alloc<T>(sizeof(holder<T>));
+				return ptr;
+			}
+
+			holder() = default;
+
+			template<typename...ArgsT>
+			explicit holder(ArgsT &&...args):mDat(std::forward<ArgsT>(args)...) {}
+
+			static T &data(void *ptr)
+			{
+				return static_cast<holder<T> *>(ptr)->mDat;
+			}
+
+			static const T &data(const void *ptr)
+			{
+				return static_cast<const holder<T> *>(ptr)->mDat;
+			}
+
+			static proxy *alloc(short protect_level)
+			{
+				return alloc_proxy(std::integral_constant<std::size_t, block_helper<holder<T>, is_hash_cached<T>::value ? sizeof(std::size_t) : 0>::value>(), protect_level);
+			}
+
+			static proxy *duplicate(const void *ptr)
+			{
+				return make_proxy<T>(0, data(ptr));
+			}
+
+			static void *duplicate_to(const void *ptr, void *buffer, std::size_t capacity)
+			{
+				return create(buffer, capacity, data(ptr));
+			}
+
+			static void *relocate(void *ptr, void *buffer, std::size_t capacity)
+			{
+				return create(buffer, capacity, std::move(data(ptr)));
+			}
+
+			static bool compare(const void *lhs, const void *rhs)
+			{
+				return cs_impl::compare(data(lhs), data(rhs));
+			}
+
+			static const std::string *text(const void *ptr)
+			{
+				return text_type<T>::get(data(ptr));
+			}
+
+			static long to_integer(const void *ptr)
+			{
+				return cs_impl::to_integer(data(ptr));
+			}
+
+			static void to_string(const void *ptr, std::string &out)
+			{
+				to_string_writer<T>::write(out, data(ptr));
+			}
+
+			static std::size_t hash(const void *ptr)
+			{
+				return cs_impl::hash<T>(data(ptr));
+			}
+
+			static void detach(void *ptr)
+			{
+				cs_impl::detach(data(ptr));
+			}
+
+			static void trace(const void *ptr, void (*visit)(const any &, void *), void *ctx)
+			{
+				var_tracer<T>::trace(data(ptr), visit, ctx);
+			}
+
+			static void clear(void *ptr)
+			{
+				var_tracer<T>::clear(data(ptr));
+			}
+
+			static void destroy(void *ptr) noexcept
+			{
+				static_cast<holder<T> *>(ptr)->~holder();
+				count_free<T>(sizeof(holder<T>));
+			}
+
+			static void kill(void *ptr) noexcept
+			{
+				if (in_arena && cs::var_arena::contains(ptr)) {
+					static_cast<holder<T> *>(ptr)->~holder();
+					cs::var_arena::release(ptr);
+				}
+				else {
+					allocator.free(static_cast<holder<T> *>(ptr));
+					cs::memory_budget::refund(sizeof(holder<T>));
+				}
+				count_free<T>(sizeof(holder<T>));
+			}
+
+			static constexpr operation_table ops = {
+				&typeid(T), &type_id_holder<T>::slot, &alloc, sizeof(holder<T>), is_var_container<T>::value, var_tracer<T>::value, is_hash_cached<T>::value, &trace, &clear, &duplicate, &duplicate_to, &relocate, &compare, text_type<T>::value ? &text : nullptr, &to_integer, &to_string, &hash,
+				&detach, &destroy, &kill, &cs_impl::get_ext<T>, &cs_impl::get_name_of_type<T>
+			};
+		};
+
+		/*
+		* Proxy and holder share one allocation, the holder is constructed right after the proxy header
+		* when it fits in the block. The header is 16 bytes unless reference counts are biased. Blocks are
+		* grouped into size classes of default_block_granularity bytes. Holders allocated separately and
+		* proxies without a payload of their own use a block of the smallest class, which keeps the pointer
+		* to the payload and the link to another proxy.
+		* Size class, protect level and other flags are packed into spare bits of the reference count.
+		*/
+		struct alignas(std::max_align_t) proxy {
+			static constexpr unsigned block_mask = 0xF;
+			static constexpr unsigned protect_shift = 4;
+			static constexpr unsigned protect_mask = 0x3 << protect_shift;
+			static constexpr unsigned flag_rvalue = 1u << 6;
+			static constexpr unsigned flag_detach = 1u << 7;
+			// Buffered as possible root of garbage cycles
+			static constexpr unsigned flag_suspected = 1u << 8;
+			static constexpr unsigned flag_hashed = 1u << 9;
+			// Copy reading the payload of a hidden snapshot proxy
+			static constexpr unsigned flag_shared = 1u << 10;
+			// Allocated from a cs::var_arena
+			static constexpr unsigned flag_arena = 1u << 11;
+			// Owner whose payload is read by copies through a snapshot
+			static constexpr unsigned flag_lent = 1u << 12;
+			// Snapshot reading the payload of its owner until the owner writes to it
+			static constexpr unsigned flag_borrowed = 1u << 13;
+			// A mutable reference to the payload is in use, so the payload is not lent until the borrowing ends
+			static constexpr unsigned flag_exposed = 1u << 14;
+			// Payload lives in the block, otherwise the block points to it
+			static constexpr unsigned flag_inline = 1u << 15;
+			// Flags describing the payload rather than the proxy
+			static constexpr unsigned payload_flags = flag_detach | flag_hashed | flag_exposed;
+			// Count of live handles to the payload, a saturated count is kept for good
+			static constexpr unsigned handle_shift = 16;
+			static constexpr unsigned handle_mask = 0xFu << handle_shift;
+
+			// Lent owners keep their snapshot instead of the operation table, which the snapshot holds as well
+			union head_type {
+				const operation_table *ops;
+				proxy *lent;
+			};
+
+			// Start of the block of proxies whose payload does not live there
+			struct slot_type {
+				void *data;
+				union {
+					// Snapshot of a copy, owner of a borrowed snapshot
+					proxy *shared;
+					// Hash code of payload allocated separately, if flag_hashed is set
+					std::size_t hash;
+				} link;
+			};
+
+			default_refcount refcount;
+			head_type head;
+
+			explicit proxy(unsigned char blk, short pl = 0)
+			{
+				static_assert(default_block_classes <= block_mask, "Size class does not fit in flags of proxy.");
+				static_assert(sizeof(slot_type) <= default_block_granularity, "Slots do not fit in the smallest block.");
+				head.ops = nullptr;
+				slot().data = nullptr;
+				slot().link.shared = nullptr;
+				refcount.set_flags(blk | static_cast<unsigned>(pl) << protect_shift);
+			}
+
+			proxy(const proxy &) = delete;
+
+			~proxy()
+			{
+				release();
+			}
+
+			bool test(unsigned flag) const noexcept
+			{
+				return refcount.flags() & flag;
+			}
+
+			void set(unsigned flag, bool value) noexcept
+			{
+				unsigned flags = refcount.flags();
+				refcount.set_flags(value ? flags | flag : flags & ~flag);
+			}
+
+			unsigned block() const noexcept
+			{
+				return refcount.flags() & block_mask;
+			}
+
+			short protect_level() const noexcept
+			{
+				return static_cast<short>((refcount.flags() & protect_mask) >> protect_shift);
+			}
+
+			// Payloads which may be written again keep no hash code
+			void set_protect_level(short pl) noexcept
+			{
+				unsigned flags = refcount.flags() & ~protect_mask;
+				if (pl < 2)
+					flags &= ~flag_hashed;
+				refcount.set_flags(flags | static_cast<unsigned>(pl) << protect_shift);
+			}
+
+			bool is_rvalue() const noexcept
+			{
+				return test(flag_rvalue);
+			}
+
+			void set_rvalue(bool value) noexcept
+			{
+				set(flag_rvalue, value);
+			}
+
+			bool detach_pending() const noexcept
+			{
+				return test(flag_detach);
+			}
+
+			bool is_exposed() const noexcept
+			{
+				return test(flag_exposed | handle_mask);
+			}
+
+			void hold() noexcept
+			{
+				unsigned flags = refcount.flags();
+				if ((flags & handle_mask) != handle_mask)
+					refcount.set_flags(flags + (1u << handle_shift));
+			}
+
+			void unhold() noexcept
+			{
+				unsigned flags = refcount.flags();
+				if ((flags & handle_mask) != handle_mask)
+					refcount.set_flags(flags - (1u << handle_shift));
+			}
+
+			const operation_table *ops() const noexcept
+			{
+				return test(flag_lent) ? head.lent->head.ops : head.ops;
+			}
+
+			// Lent owners take their operation table back before it changes
+			void set_ops(const operation_table *ops) noexcept
+			{
+				head.ops = ops;
+			}
+
+			unsigned char *buffer() const noexcept
+			{
+				return const_cast<unsigned char *>(reinterpret_cast<const unsigned char *>(this)) + sizeof(proxy);
+			}
+
+			slot_type &slot() const noexcept
+			{
+				return *reinterpret_cast<slot_type *>(buffer());
+			}
+
+			std::size_t capacity() const noexcept
+			{
+				return block() * default_block_granularity;
+			}
+
+			bool is_inline() const noexcept
+			{
+				return test(flag_inline);
+			}
+
+			// Private payload, null for copies and borrowed snapshots
+			void *data() const noexcept
+			{
+				return is_inline() ? buffer() : slot().data;
+			}
+
+			void set_data(void *ptr) noexcept
+			{
+				if (ptr != nullptr && ptr == buffer())
+					set(flag_inline, true);
+				else {
+					set(flag_inline, false);
+					slot().data = ptr;
+				}
+			}
+
+			proxy *shared() const noexcept
+			{
+				return test(flag_shared) ? slot().link.shared : nullptr;
+			}
+
+			// Proxy holding a reference this one reads the payload of, either the snapshot of a copy or the owner of a snapshot
+			proxy *source() const noexcept
+			{
+				return test(flag_shared | flag_borrowed) ? slot().link.shared : nullptr;
+			}
+
+			// Snapshot read by copies of this proxy, if any
+			proxy *snapshot() const noexcept
+			{
+				return test(flag_lent) ? head.lent : shared();
+			}
+
+			// Copies and borrowed snapshots hold no payload, so the link takes the slot next to the payload pointer
+			void set_link(unsigned flag, proxy *src) noexcept
+			{
+				slot().data = nullptr;
+				slot().link.shared = src;
+				refcount.set_flags((refcount.flags() & ~(flag_hashed | flag_inline)) | flag);
+			}
+
+			void set_shared(proxy *src) noexcept
+			{
+				set_link(flag_shared, src);
+			}
+
+			void lend(proxy *src) noexcept
+			{
+				head.lent = src;
+				refcount.set_flags((refcount.flags() & ~flag_hashed) | flag_lent);
+			}
+
+			void end_lend() noexcept
+			{
+				head.ops = head.lent->head.ops;
+				set(flag_lent, false);
+			}
+
+			// Copies read the payload of their snapshot, snapshots read the payload of their owner until it writes
+			void *payload() const noexcept
+			{
+				const proxy *src = test(flag_shared) ? slot().link.shared : this;
+				if (src->test(flag_borrowed))
+					src = src->slot().link.shared;
+				return src->data();
+			}
+
+			// Hash code lives in spare room at the end of the block, or next to the pointer to the payload
+			std::size_t *hash_slot() const noexcept
+			{
+				if (!is_inline())
+					return &slot().link.hash;
+				if (capacity() < head.ops->size + sizeof(std::size_t))
+					return nullptr;
+				return reinterpret_cast<std::size_t *>(buffer() + capacity() - sizeof(std::size_t));
+			}
+
+			bool get_hash(std::size_t &code) const noexcept
+			{
+				if (!test(flag_hashed))
+					return false;
+				code = *hash_slot();
+				return true;
+			}
+
+			/*
+			* Only constant payloads no mutable reference was handed out for are never written, so only
+			* they cache hash codes. Readers on other threads must not write the flags.
+			*/
+			void set_hash(std::size_t code) noexcept
+			{
+				if (!default_refcount::concurrent && protect_level() > 1 && !is_exposed() && !test(flag_shared | flag_lent | flag_borrowed)) {
+					std::size_t *slot = hash_slot();
+					if (slot != nullptr) {
+						*slot = code;
+						set(flag_hashed, true);
+					}
+				}
+			}
+
+			// Only private payloads may be written, copies own no hash code
+			void drop_hash() noexcept
+			{
+				set(flag_hashed, false);
+			}
+
+			// Lent owners are never released, their snapshot holds a reference to them
+			void release() noexcept
+			{
+				if (test(flag_shared)) {
+					proxy *src = slot().link.shared;
+					set_link(0, nullptr);
+					set(flag_shared | flag_detach, false);
+					release_reference(src);
+				}
+				else if (test(flag_borrowed)) {
+					proxy *src = slot().link.shared;
+					set_link(0, nullptr);
+					set(flag_borrowed, false);
+					src->end_lend();
+					release_reference(src);
+				}
+				else {
+					drop_hash();
+					void *dat = data();
+					if (dat != nullptr) {
+						if (is_inline())
+							head.ops->destroy(dat);
+						else
+							head.ops->kill(dat);
+						set_data(nullptr);
+					}
+				}
+			}
+
+			/*
+			* Take a private copy of shared payload before writing to it.
+			* The last copy takes over a payload the snapshot allocated separately instead of duplicating it.
+			* A duplicate constructed in the block overwrites the link, which is put back if construction throws.
+			*/
+			void unshare()
+			{
+				proxy *src = slot().link.shared;
+				// A copy always holds its snapshot, say so explicitly for the optimizer
+				if (src == nullptr) {
+					set(flag_shared, false);
+					return;
+				}
+				if (src->refcount.unique() && !src->test(flag_borrowed) && !src->is_inline()) {
+					set_link(0, nullptr);
+					set(flag_shared, false);
+					set_data(src->slot().data);
+					src->set_data(nullptr);
+				}
+				else {
+					void *dat = nullptr;
+					try {
+						dat = head.ops->duplicate_to(src->payload(), buffer(), capacity());
+					}
+					catch (...) {
+						set_shared(src);
+						throw;
+					}
+					set(flag_shared, false);
+					set_data(dat);
+				}
+				release_reference(src);
+				if (detach_pending()) {
+					set(flag_detach, false);
+					head.ops->detach(data());
+				}
+			}
+
+			// The owner keeps its payload in place, so the snapshot read by copies takes a duplicate
+			void reclaim()
+			{
+				proxy *src = head.lent;
+				void *dat = nullptr;
+				try {
+					dat = src->head.ops->duplicate_to(data(), src->buffer(), src->capacity());
+				}
+				catch (...) {
+					src->set_link(flag_borrowed, this);
+					throw;
+				}
+				src->set(flag_borrowed, false);
+				src->set_data(dat);
+				end_lend();
+				release_reference(this);
+			}
+
+			// Make the payload private before writing to it
+			void own()
+			{
+				if (test(flag_shared))
+					unshare();
+				else if (test(flag_lent))
+					reclaim();
+			}
+
+			// Move a holder living in the block out of line, holders in blocks are moved without throwing
+			void move_out()
+			{
+				void *dat = head.ops->relocate(data(), nullptr, 0);
+				head.ops->destroy(data());
+				set_data(dat);
+			}
+
+			/*
+			* Exchange private payloads, holders living in a block are moved into the block of another proxy.
+			* A holder which may not fit there is moved out of line first, so nothing throws once the
+			* payloads start moving and a failed exchange leaves both proxies holding their own payload.
+			*/
+			void swap_data(proxy *obj)
+			{
+				own();
+				obj->own();
+				drop_hash();
+				obj->drop_hash();
+				if (is_inline() && capacity() > obj->capacity())
+					move_out();
+				else if (obj->is_inline() && obj->capacity() > capacity())
+					obj->move_out();
+				unsigned flags = refcount.flags() & payload_flags, obj_flags = obj->refcount.flags() & payload_flags;
+				const operation_table *dat_ops = head.ops, *obj_ops = obj->head.ops;
+				if (!is_inline() && !obj->is_inline()) {
+					void *dat = data();
+					set_data(obj->data());
+					obj->set_data(dat);
+				}
+				else {
+					block_buffer tmp;
+					void *dat = data();
+					if (is_inline()) {
+						dat = dat_ops->relocate(dat, &tmp, sizeof(tmp));
+						release();
+					}
+					if (obj->is_inline()) {
+						set_data(obj_ops->relocate(obj->data(), buffer(), capacity()));
+						obj->release();
+					}
+					else
+						set_data(obj->data());
+					if (dat == static_cast<void *>(&tmp)) {
+						obj->set_data(dat_ops->relocate(dat, obj->buffer(), obj->capacity()));
+						dat_ops->destroy(dat);
+					}
+					else
+						obj->set_data(dat);
+				}
+				head.ops = obj_ops;
+				obj->head.ops = dat_ops;
+				refcount.set_flags((refcount.flags() & ~payload_flags) | obj_flags);
+				obj->refcount.set_flags((obj->refcount.flags() & ~payload_flags) | flags);
+				// References handed out before refer to either payload now
+				if ((flags | obj_flags) & flag_exposed) {
+					set(flag_exposed, true);
+					obj->set(flag_exposed, true);
+				}
+			}
+		};
+
+		struct block_buffer {
+			alignas(proxy) unsigned char data[default_block_granularity * default_block_classes];
+		};
+
+		/*
+		* Holders are moved between blocks by raw swap, which must not throw halfway,
+		* so only holders which are nothrow move constructible live in blocks.
+		* Blocks of holders caching hash codes leave spare bytes for the hash code if they can.
+		*/
+		template<typename T, std::size_t spare = 0>
+		struct block_helper {
+			static constexpr bool fits(std::size_t capacity)
+			{
+				return sizeof(T) <= capacity && alignof(T) <= alignof(proxy) && std::is_nothrow_move_constructible<T>::value;
+			}
+
+			static constexpr std::size_t size = sizeof(T) + spare <= sizeof(block_buffer) ? sizeof(T) + spare : sizeof(T);
+
+			// Size class of the block, the smallest one if the holder has to be allocated separately
+			static constexpr std::size_t value = fits(sizeof(block_buffer)) ? (size + default_block_granularity - 1) / default_block_granularity : 1;
+		};
+
+		template<std::size_t N>
+		struct proxy_block final {
+			proxy header;
+			unsigned char buffer[N * default_block_granularity];
+
+			explicit proxy_block(short pl) : header(N, pl) {}
+
+			static cs::allocator_type<proxy_block<N>, default_allocate_buffer_size*default_allocate_buffer_multiplier, default_allocator_provider> allocator;
+
+			static proxy *alloc(short pl)
+			{
+				cs::var_arena *arena = cs::var_arena::current();
+				proxy *ptr = nullptr;
+				if (arena == nullptr) {
+					// Arenas charge whole chunks instead
+					cs::memory_budget::charge(sizeof(proxy_block<N>));
+					try {
+						ptr = &allocator.alloc(pl)->header;
+					}
+					catch (...) {
+						cs::memory_budget::refund(sizeof(proxy_block<N>));
+						throw;
+					}
+				}
+				else
+					ptr = alloc_arena_proxy(::new(arena->allocate(sizeof(proxy_block<N>))) proxy_block<N>(pl));
+				count_alloc<proxy>(sizeof(proxy_block<N>));
+				return ptr;
+			}
+
+			static void free(proxy *ptr) noexcept
+			{
+				allocator.free(reinterpret_cast<proxy_block<N> *>(ptr));
+				cs::memory_budget::refund(sizeof(proxy_block<N>));
+				count_free<proxy>(sizeof(proxy_block<N>));
+			}
+		};
+
+		template<typename T>
+		static proxy *alloc_arena_proxy(T *block) noexcept
+		{
+			proxy *ptr = reinterpret_cast<proxy *>(block);
+			ptr->set(proxy::flag_arena, true);
+			return ptr;
+		}
+
+		template<std::size_t N>
+		static proxy *alloc_proxy(std::integral_constant<std::size_t, N>, short pl)
+		{
+			return proxy_block<N>::alloc(pl);
+		}
+
+		template<std::size_t...N>
+		static void free_proxy(proxy *ptr, std::index_sequence<N...>) noexcept
+		{
+			static void (*const table[])(proxy *) = {&proxy_block<N + 1>::free...};
+			table[ptr->block() - 1](ptr);
+		}
+
+		// Blocks of arenas are never cached by pools
+		static void free_arena_proxy(proxy *ptr) noexcept
+		{
+			std::size_t size = sizeof(proxy) + ptr->block() * default_block_granularity;
+			ptr->~proxy();
+			cs::var_arena::release(ptr);
+			count_free<proxy>(size);
+		}
+
+		static void free_proxy(proxy *ptr) noexcept
+		{
+			if (ptr->test(proxy::flag_arena))
+				free_arena_proxy(ptr);
+			else
+				free_proxy(ptr, std::make_index_sequence<default_block_classes>());
+		}
+
+		static void release_proxy(void *ptr) noexcept
+		{
+			free_proxy(static_cast<proxy *>(ptr));
+		}
+
+		// Free a proxy without references
+		static void dispose(proxy *ptr) noexcept
+		{
+#ifdef COVSCRIPT_VAR_CYCLE_COLLECTOR
+			if (ptr->test(proxy::flag_suspected))
+				cycle_forget(ptr);
+#endif
+#ifdef COVSCRIPT_VAR_DEFERRED_RELEASE
+			if (ptr->source() == nullptr && ptr->ops() != nullptr && ptr->ops()->deferred && defer_release(ptr, &release_proxy))
+				return;
+#endif
+			free_proxy(ptr);
+		}
+
+		// Containers surviving a release may be left in a garbage cycle
+		static void suspect(proxy *ptr) noexcept
+		{
+#ifdef COVSCRIPT_VAR_CYCLE_COLLECTOR
+			if (!ptr->test(proxy::flag_suspected) && ptr->ops() != nullptr && ptr->ops()->traced)
+				ptr->set(proxy::flag_suspected, cycle_suspect(ptr));
+#else
+			(void) ptr;
+#endif
+		}
+
+		static void release_reference(proxy *ptr) noexcept
+		{
+			if (ptr->refcount.decrease(ptr, &release_proxy))
+				dispose(ptr);
+			else
+				suspect(ptr);
+		}
+
+		/*
+		* Storage of variable
+		* proxy_word refers to a proxy or nullptr.
+		* compact_word encodes doubles, booleans, integers and small numerics directly in a 64-bit word, proxy
+		* pointers and null are kept in the NaN space of double. Immediate values are never shared, they are
+		* moved into a proxy once a second reference, a protect level or a reference to a boxed value is needed.
+		*/
+		class proxy_word final {
+			proxy *m_ptr = nullptr;
+		public:
+			template<typename T>
+			static constexpr bool fits() noexcept
+			{
+				return false;
+			}
+
+			static constexpr bool is_immediate() noexcept
+			{
+				return false;
+			}
+
+			bool usable() const noexcept
+			{
+				return m_ptr != nullptr;
+			}
+
+			proxy *get() const noexcept
+			{
+				return m_ptr;
+			}
+
+			void set(proxy *ptr) noexcept
+			{
+				m_ptr = ptr;
+			}
+
+			const operation_table *ops() const noexcept
+			{
+				return nullptr;
+			}
+
+			const operation_table *holder_ops() const noexcept
+			{
+				return nullptr;
+			}
+
+			static constexpr bool is_boxed() noexcept
+			{
+				return false;
+			}
+
+			template<typename T>
+			static constexpr bool referable(bool) noexcept
+			{
+				return true;
+			}
+
+			cs::numeric load_numeric() const noexcept
+			{
+				return cs::numeric();
+			}
+
+			template<typename T>
+			static constexpr bool holds() noexcept
+			{
+				return false;
+			}
+
+			void *data() noexcept
+			{
+				return &m_ptr;
+			}
+
+			bool is_rvalue() const noexcept
+			{
+				return false;
+			}
+
+			bool mark_as_rvalue(bool) noexcept
+			{
+				return false;
+			}
+
+			template<typename T>
+			bool store(const T &) noexcept
+			{
+				return false;
+			}
+
+			bool store_copy(const operation_table *, const void *) noexcept
+			{
+				return false;
+			}
+
+			bool operator==(const proxy_word &word) const noexcept
+			{
+				return m_ptr == word.m_ptr;
+			}
+
+			void swap(proxy_word &word) noexcept
+			{
+				std::swap(m_ptr, word.m_ptr);
+			}
+		};
+
+		class compact_word final {
+			static constexpr std::uint64_t tag_mask = 0xFFFF000000000000ull;
+			// Quiet NaNs with these prefixes are never produced by arithmetic
+			static constexpr std::uint64_t proxy_tag = 0xFFF9000000000000ull;
+			static constexpr std::uint64_t bool_tag = 0xFFFA000000000000ull;
+			static constexpr std::uint64_t int_tag = 0xFFFB000000000000ull;
+			// Numerics holding an integer of 32 bits or a float of single precision
+			static constexpr std::uint64_t numeric_int_tag = 0xFFFC000000000000ull;
+			static constexpr std::uint64_t numeric_float_tag = 0xFFFD000000000000ull;
+			// Immediate values are stored in the lower bytes, the flag is out of their way
+			static constexpr std::uint64_t rvalue_flag = 0x0000800000000000ull;
+
+			std::uint64_t m_word = proxy_tag;
+
+			bool has_flags() const noexcept
+			{
+				std::uint64_t tag = m_word & tag_mask;
+				return tag >= bool_tag && tag <= numeric_float_tag;
+			}
+
+		public:
+			template<typename T>
+			static constexpr bool fits() noexcept
+			{
+				return std::is_same<T, bool>::value || std::is_same<T, int>::value || std::is_same<T, double>::value || std::is_same<T, cs::numeric>::value;
+			}
+
+			/*
+			* Whether the word can be referred to as a T, boxed values can't. Values to be written are always
+			* promoted: a later copy or protect promotes the word into a pointer, which must not be written
+			* through a reference handed out before, and a double written in place could look like a tag.
+			*/
+			template<typename T>
+			static constexpr bool referable(bool write) noexcept
+			{
+				return !std::is_same<T, cs::numeric>::value && !write;
+			}
+
+			static cs::numeric load_numeric(std::uint64_t word) noexcept
+			{
+				std::uint32_t bits = static_cast<std::uint32_t>(word);
+				if ((word & tag_mask) == numeric_int_tag)
+					return cs::numeric(static_cast<std::int32_t>(bits));
+				float value = 0;
+				std::memcpy(&value, &bits, sizeof(value));
+				return cs::numeric(value);
+			}
 
-			virtual ~ baseHolder() = default;
+			bool is_immediate() const noexcept
+			{
+				return (m_word & tag_mask) != proxy_tag;
+			}
 
-			virtual const std::type_info &type() const = 0;
+			bool usable() const noexcept
+			{
+				return m_word != proxy_tag;
+			}
 
-			virtual baseHolder *duplicate() = 0;
+			proxy *get() const noexcept
+			{
+				return (m_word & tag_mask) == proxy_tag ? reinterpret_cast<proxy *>(static_cast<std::uintptr_t>(m_word & ~tag_mask)) : nullptr;
+			}
 
-			virtual bool compare(const baseHolder *) const = 0;
+			// User space addresses of 64-bit platforms fit in 48 bits
+			void set(proxy *ptr) noexcept
+			{
+				m_word = proxy_tag | static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(ptr));
+			}
 
-			virtual long to_integer() const = 0;
+			const operation_table *ops() const noexcept
+			{
+				switch (m_word & tag_mask) {
+				case bool_tag:
+					return &holder<bool>::ops;
+				case int_tag:
+					return &holder<int>::ops;
+				case numeric_int_tag:
+				case numeric_float_tag:
+					return &boxed<cs::numeric>::ops;
+				default:
+					return &holder<double>::ops;
+				}
+			}
 
-			virtual std::string to_string() const = 0;
+			// Operation table of the proxy an immediate value is promoted to
+			const operation_table *holder_ops() const noexcept
+			{
+				return is_boxed() ? &holder<cs::numeric>::ops : ops();
+			}
 
-			virtual std::size_t hash() const = 0;
+			bool is_boxed() const noexcept
+			{
+				return (m_word & tag_mask) == numeric_int_tag || (m_word & tag_mask) == numeric_float_tag;
+			}
 
-			virtual void detach() = 0;
+			// Operation tables of immediate values always belong to current module
+			template<typename T>
+			bool holds() const noexcept
+			{
+				return std::is_same<T, cs::numeric>::value ? is_boxed() : ops() == &holder<T>::ops;
+			}
 
-			virtual void kill() = 0;
+			cs::numeric load_numeric() const noexcept
+			{
+				return load_numeric(m_word);
+			}
 
-			virtual cs::namespace_t &get_ext() const = 0;
+			// Holders of immediate types only contain the value, so the word can be used as one
+			void *data() noexcept
+			{
+				return &m_word;
+			}
 
-			virtual const char *get_type_name() const = 0;
-		};
+			bool is_rvalue() const noexcept
+			{
+				return has_flags() && (m_word & rvalue_flag);
+			}
 
-		template<typename T>
-		class holder : public baseHolder {
-		protected:
-			T mDat;
-		public:
-			static default_allocator<holder<T>> allocator;
+			// Return false if the flag can not be represented
+			bool mark_as_rvalue(bool value) noexcept
+			{
+				if (!has_flags())
+					return !value;
+				if (value)
+					m_word |= rvalue_flag;
+				else
+					m_word &= ~rvalue_flag;
+				return true;
+			}
 
-			holder() = default;
+			// Return false if the value has to be held by a proxy
+			template<typename T>
+			bool store(const T &) noexcept
+			{
+				return false;
+			}
 
-			template<typename...ArgsT>
-			explicit holder(ArgsT &&...args):mDat(std::forward<ArgsT>(args)...) {}
+			bool store(bool value) noexcept
+			{
+				m_word = bool_tag | static_cast<std::uint64_t>(value);
+				return true;
+			}
 
-			~ holder() override = default;
+			bool store(int value) noexcept
+			{
+				m_word = int_tag | static_cast<std::uint32_t>(value);
+				return true;
+			}
 
-			const std::type_info &type() const override
+			bool store(double value) noexcept
 			{
-				return typeid(T);
+				if (value != value)
+					value = std::numeric_limits<double>::quiet_NaN();
+				std::memcpy(&m_word, &value, sizeof(value));
+				return true;
 			}
 
-			baseHolder *duplicate() override
+			bool store(const cs::numeric &value) noexcept
 			{
-				return allocator.alloc(mDat);
+				if (value.is_integer()) {
+					cs::numeric_integer num = value.as_integer();
+					if (num < std::numeric_limits<std::int32_t>::min() || num > std::numeric_limits<std::int32_t>::max())
+						return false;
+					m_word = numeric_int_tag | static_cast<std::uint32_t>(static_cast<std::int32_t>(num));
+				}
+				else {
+					cs::numeric_float num = value.as_float();
+					// NaNs and floats out of range fail the first test
+					if (!(num >= -std::numeric_limits<float>::max() && num <= std::numeric_limits<float>::max()) || static_cast<float>(num) != num)
+						return false;
+					float single = static_cast<float>(num);
+					std::uint32_t bits = 0;
+					std::memcpy(&bits, &single, sizeof(bits));
+					m_word = numeric_float_tag | bits;
+				}
+				return true;
 			}
 
-			bool compare(const baseHolder *obj) const override
+			bool store_copy(const operation_table *ops, const void *data) noexcept
 			{
-				if (obj->type() == this->type())
-					return cs_impl::compare(mDat, static_cast<const holder<T> *>(obj)->data());
+				if (ops == &holder<bool>::ops)
+					return store(holder<bool>::data(data));
+				else if (ops == &holder<int>::ops)
+					return store(holder<int>::data(data));
+				else if (ops == &holder<double>::ops)
+					return store(holder<double>::data(data));
+				else if (ops == &holder<cs::numeric>::ops)
+					return store(holder<cs::numeric>::data(data));
 				else
 					return false;
 			}
 
-			long to_integer() const override
+			bool operator==(const compact_word &word) const noexcept
 			{
-				return cs_impl::to_integer(mDat);
+				return m_word == word.m_word;
 			}
 
-			std::string to_string() const override
+			void swap(compact_word &word) noexcept
 			{
-				return cs_impl::to_string(mDat);
+				std::swap(m_word, word.m_word);
 			}
+		};
 
-			std::size_t hash() const override
+		/*
+		* Operation table of values boxed in a compact word, the data pointer refers to the word.
+		* Boxed values are decoded into a holder on the stack, and promoted into a proxy holding
+		* the type itself once a reference is needed.
+		*/
+		template<typename T>
+		class boxed final {
+			static holder<T> load(const void *ptr) noexcept
 			{
-				return cs_impl::hash<T>(mDat);
+				return holder<T>(compact_word::load_numeric(*static_cast<const std::uint64_t *>(ptr)));
 			}
 
-			void detach() override
+		public:
+			static proxy *duplicate(const void *ptr)
 			{
-				cs_impl::detach(mDat);
+				holder<T> dat = load(ptr);
+				return make_proxy<T>(0, holder<T>::data(&dat));
 			}
 
-			void kill() override
+			static void *duplicate_to(const void *ptr, void *buffer, std::size_t capacity)
 			{
-				allocator.free(this);
+				holder<T> dat = load(ptr);
+				return holder<T>::create(buffer, capacity, holder<T>::data(&dat));
 			}
 
-			virtual cs::namespace_t &get_ext() const override
+			static void *relocate(void *ptr, void *buffer, std::size_t capacity)
 			{
-				return cs_impl::get_ext<T>();
+				return duplicate_to(ptr, buffer, capacity);
 			}
 
-			const char *get_type_name() const override
+			static bool compare(const void *lhs, const void *rhs)
 			{
-				return cs_impl::get_name_of_type<T>();
+				holder<T> a = load(lhs), b = load(rhs);
+				return holder<T>::compare(&a, &b);
 			}
 
-			T &data()
+			static long to_integer(const void *ptr)
 			{
-				return mDat;
+				holder<T> dat = load(ptr);
+				return holder<T>::to_integer(&dat);
 			}
 
-			const T &data() const
+			static void to_string(const void *ptr, std::string &out)
 			{
-				return mDat;
+				holder<T> dat = load(ptr);
+				holder<T>::to_string(&dat, out);
 			}
 
-			void data(const T &dat)
+			static std::size_t hash(const void *ptr)
 			{
-				mDat = dat;
+				holder<T> dat = load(ptr);
+				return holder<T>::hash(&dat);
 			}
+
+			static void trace(const void *, void (*)(const any &, void *), void *) {}
+
+			static void ignore(void *) noexcept {}
+
+			static constexpr operation_table ops = {
+				&typeid(T), &type_id_holder<T>::slot, &holder<T>::alloc, sizeof(holder<T>), false, false, false, &trace, &ignore, &duplicate, &duplicate_to, &relocate, &compare, nullptr, &to_integer, &to_string, &hash,
+				&ignore, &ignore, &ignore, &cs_impl::get_ext<T>, &cs_impl::get_name_of_type<T>
+			};
 		};
 
-		struct proxy {
-			bool is_rvalue = false;
-			short protect_level = 0;
-			std::size_t refcount = 1;
-			baseHolder *data = nullptr;
+#ifdef COVSCRIPT_VAR_COMPACT
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error Compact variables require a little-endian platform
+#endif
+		static_assert(sizeof(void *) == sizeof(std::uint64_t), "Compact variables require a 64-bit platform");
+		using value_word = compact_word;
+#else
+		using value_word = proxy_word;
+#endif
 
-			proxy(std::size_t rc, baseHolder *d) : refcount(rc), data(d) {}
+		template<typename T>
+		using is_immediate_t = std::integral_constant<bool, value_word::template fits<T>()>;
 
-			proxy(short pl, std::size_t rc, baseHolder *d) : protect_level(pl), refcount(rc), data(d) {}
+		mutable value_word mDat;
 
-			~proxy()
-			{
-				if (data != nullptr)
-					data->kill();
+		template<typename T, typename...ArgsT>
+		static proxy *make_proxy(short protect_level, ArgsT &&...args)
+		{
+			default_refcount::poll();
+			proxy *dat = holder<T>::alloc(protect_level);
+			try {
+				dat->set_data(holder<T>::create(dat->buffer(), dat->capacity(), std::forward<ArgsT>(args)...));
+				dat->set_ops(&holder<T>::ops);
 			}
-		};
+			catch (...) {
+				// Construction may have written to the block
+				dat->set_data(nullptr);
+				free_proxy(dat);
+				throw;
+			}
+#ifdef COVSCRIPT_VAR_CYCLE_COLLECTOR
+			if (var_tracer<T>::value)
+				cycle_allocated();
+#endif
+			return dat;
+		}
+
+		/*
+		* Copy on write: the source keeps its payload in place and lends it to a hidden snapshot proxy,
+		* copies read the payload through the snapshot. A copy asking for write access through val<T>(),
+		* raw assign or detach takes its own duplicate, the source writing to its payload gives the
+		* snapshot a duplicate first. So references obtained from the source stay valid, references
+		* obtained from a copy are invalidated once the copy or its source is written.
+		* Payloads a mutable reference or handle is in use for may be written without notice, and with
+		* biased reference counts proxies may be read by other threads, so such payloads are never lent.
+		* Their copies share a duplicate instead, which nobody writes to, so copies of copies stay cheap.
+		*/
+		static proxy *share_proxy(proxy *obj)
+		{
+			proxy *dat = obj->ops()->alloc(0);
+			proxy *src = obj->snapshot();
+			if (src != nullptr)
+				src->refcount.increase();
+			else if (default_refcount::concurrent || obj->is_exposed()) {
+				try {
+					src = obj->ops()->duplicate(obj->payload());
+				}
+				catch (...) {
+					free_proxy(dat);
+					throw;
+				}
+			}
+			else {
+				try {
+					src = alloc_proxy(std::integral_constant<std::size_t, 1>(), 0);
+				}
+				catch (...) {
+					free_proxy(dat);
+					throw;
+				}
+				// The snapshot holds a reference to its owner, so the lent payload lives as long as it is read
+				src->set_ops(obj->ops());
+				src->set_link(proxy::flag_borrowed, obj);
+				obj->lend(src);
+				obj->refcount.increase();
+			}
+			dat->set_ops(obj->ops());
+			dat->set_shared(src);
+			dat->set(proxy::flag_detach, obj->detach_pending());
+			return dat;
+		}
+
+		template<typename T, typename...ArgsT>
+		static void store_value(value_word &word, std::true_type, short protect_level, ArgsT &&...args)
+		{
+			T value(std::forward<ArgsT>(args)...);
+			if (!word.store(value))
+				word.set(make_proxy<T>(protect_level, std::move(value)));
+		}
+
+		template<typename T, typename...ArgsT>
+		static void store_value(value_word &word, std::false_type, short protect_level, ArgsT &&...args)
+		{
+			word.set(make_proxy<T>(protect_level, std::forward<ArgsT>(args)...));
+		}
+
+		template<typename T>
+		static bool is_type_of(const operation_table *ops, std::false_type)
+		{
+			return ops != nullptr && ops->template is_type_of<T>();
+		}
+
+		template<typename T>
+		static bool is_type_of(const operation_table *ops, std::true_type)
+		{
+			return ops == nullptr;
+		}
+
+		// Move an immediate value into a proxy, so it can be shared or protected
+		proxy *promote() const
+		{
+			if (mDat.is_immediate()) {
+				const operation_table *ops = mDat.ops();
+				proxy *dat = ops->alloc(0);
+				dat->set_data(ops->duplicate_to(mDat.data(), dat->buffer(), dat->capacity()));
+				dat->set_ops(mDat.holder_ops());
+				dat->set_rvalue(mDat.is_rvalue());
+				mDat.set(dat);
+			}
+			return mDat.get();
+		}
+
+		const operation_table *get_ops() const noexcept
+		{
+			if (mDat.is_immediate())
+				return mDat.ops();
+			proxy *dat = mDat.get();
+			return dat != nullptr ? dat->ops() : nullptr;
+		}
 
-		static cs::allocator_type<proxy, default_allocate_buffer_size*default_allocate_buffer_multiplier, default_allocator_provider> allocator;
+		void *get_data() const noexcept
+		{
+			return mDat.is_immediate() ? mDat.data() : mDat.get()->payload();
+		}
 
-		proxy *mDat = nullptr;
+		// Word holding a new copy of the value
+		value_word copy_value() const
+		{
+			value_word word;
+			if (mDat.is_immediate()) {
+				word = mDat;
+				word.mark_as_rvalue(false);
+			}
+			else if (mDat.usable()) {
+				proxy *dat = mDat.get();
+				if (!word.store_copy(dat->ops(), dat->payload()))
+					word.set(share_proxy(dat));
+			}
+			return word;
+		}
 
-		proxy *duplicate() const noexcept
+		proxy *duplicate() const
 		{
-			if (mDat != nullptr) {
-				++mDat->refcount;
+			proxy *dat = promote();
+			if (dat != nullptr) {
+				dat->refcount.increase();
 			}
-			return mDat;
+			return dat;
 		}
 
 		void recycle() noexcept
 		{
-			if (mDat != nullptr) {
-				--mDat->refcount;
-				if (mDat->refcount == 0) {
-					allocator.free(mDat);
-					mDat = nullptr;
+			proxy *dat = mDat.get();
+			if (dat != nullptr) {
+				if (dat->refcount.decrease(dat, &release_proxy)) {
+					dispose(dat);
+					mDat.set(nullptr);
 				}
+				else
+					suspect(dat);
 			}
 		}
 
-		explicit any(proxy *dat) : mDat(dat) {}
+		explicit any(proxy *dat)
+		{
+			mDat.set(dat);
+		}
+
+		// Rvalues of types other than any
+		template<typename T>
+		using is_movable_t = std::integral_constant<bool, !std::is_reference<T>::value && !std::is_const<T>::value && !std::is_same<T, any>::value>;
+
+		template<typename T, typename...ArgsT>
+		void replace(bool raw, ArgsT &&...args)
+		{
+			proxy *ptr = mDat.get();
+			if (ptr != nullptr && raw) {
+				if (ptr->is_rvalue() || ptr->protect_level() > 0)
+					throw cov::error("E000J");
+				if (ptr->test(proxy::flag_lent))
+					ptr->reclaim();
+				ptr->release();
+				ptr->set(proxy::flag_exposed, false);
+				ptr->set_data(holder<T>::create(ptr->buffer(), ptr->capacity(), std::forward<ArgsT>(args)...));
+				ptr->set_ops(&holder<T>::ops);
+			}
+			else {
+				if (mDat.is_immediate() && raw && is_rvalue())
+					throw cov::error("E000J");
+				// Arguments may refer to current value
+				value_word word;
+				store_value<T>(word, is_immediate_t<T>(), 0, std::forward<ArgsT>(args)...);
+				recycle();
+				mDat = word;
+			}
+		}
 
 	public:
 		void swap(any &obj, bool raw = false)
 		{
-			if (this->mDat != nullptr && obj.mDat != nullptr && raw) {
-				if (mDat->is_rvalue || this->mDat->protect_level > 0 || obj.mDat->protect_level > 0)
+			if (this->usable() && obj.usable() && raw) {
+				if (is_rvalue() || is_protect() || obj.is_protect())
 					throw cov::error("E000J");
-				std::swap(this->mDat->data, obj.mDat->data);
+				if (mDat.is_immediate() && obj.mDat.is_immediate() && !obj.mDat.is_rvalue())
+					mDat.swap(obj.mDat);
+				else
+					promote()->swap_data(obj.promote());
 			}
 			else
-				std::swap(this->mDat, obj.mDat);
+				mDat.swap(obj.mDat);
 		}
 
 		void swap(any &&obj, bool raw = false)
 		{
-			if (this->mDat != nullptr && obj.mDat != nullptr && raw) {
-				if (mDat->is_rvalue || this->mDat->protect_level > 0 || obj.mDat->protect_level > 0)
-					throw cov::error("E000J");
-				std::swap(this->mDat->data, obj.mDat->data);
-			}
-			else
-				std::swap(this->mDat, obj.mDat);
+			swap(obj, raw);
 		}
 
 		void clone()
 		{
-			if (mDat != nullptr) {
-				if (mDat->protect_level > 2)
+			if (mDat.usable()) {
+				if (is_single())
 					throw cov::error("E000L");
-				proxy *dat = allocator.alloc(1, mDat->data->duplicate());
+				value_word word = copy_value();
 				recycle();
-				mDat = dat;
+				mDat = word;
 			}
 		}
 
 		void try_move() const
 		{
-			if (mDat != nullptr && mDat->refcount == 1) {
-				mDat->protect_level = 0;
-				mDat->is_rvalue = true;
+			if (mDat.is_immediate()) {
+				if (!mDat.mark_as_rvalue(true))
+					promote()->set_rvalue(true);
+			}
+			else if (mDat.usable() && mDat.get()->refcount.unique()) {
+				mDat.get()->set_protect_level(0);
+				mDat.get()->set_rvalue(true);
 			}
 		}
 
 		bool usable() const noexcept
 		{
-			return mDat != nullptr;
+			return mDat.usable();
 		}
 
 		template<typename T, typename...ArgsT>
 		static any make(ArgsT &&...args)
 		{
-			return any(allocator.alloc(1, holder<T>::allocator.alloc(std::forward<ArgsT>(args)...)));
+			any var;
+			store_value<T>(var.mDat, is_immediate_t<T>(), 0, std::forward<ArgsT>(args)...);
+			return var;
 		}
 
 		template<typename T, typename...ArgsT>
 		static any make_protect(ArgsT &&...args)
 		{
-			return any(allocator.alloc(1, 1, holder<T>::allocator.alloc(std::forward<ArgsT>(args)...)));
+			return any(make_proxy<T>(1, std::forward<ArgsT>(args)...));
 		}
 
 		template<typename T, typename...ArgsT>
 		static any make_constant(ArgsT &&...args)
 		{
-			return any(allocator.alloc(2, 1, holder<T>::allocator.alloc(std::forward<ArgsT>(args)...)));
+			return any(make_proxy<T>(2, std::forward<ArgsT>(args)...));
 		}
 
 		template<typename T, typename...ArgsT>
 		static any make_single(ArgsT &&...args)
 		{
-			return any(allocator.alloc(3, 1, holder<T>::allocator.alloc(std::forward<ArgsT>(args)...)));
+			return any(make_proxy<T>(3, std::forward<ArgsT>(args)...));
 		}
 
 		constexpr any() = default;
 
 		template<typename T>
-		any(const T &dat):mDat(allocator.alloc(1, holder<T>::allocator.alloc(dat))) {}
+		any(const T &dat)
+		{
+			store_value<T>(mDat, is_immediate_t<T>(), 0, dat);
+		}
 
-		any(const any &v) : mDat(v.duplicate()) {}
+		template<typename T, typename = typename std::enable_if<is_movable_t<T>::value>::type>
+		any(T &&dat)
+		{
+			store_value<T>(mDat, is_immediate_t<T>(), 0, std::move(dat));
+		}
+
+		any(const any &v)
+		{
+			mDat.set(v.duplicate());
+		}
 
 		any(any &&v) noexcept
 		{
@@ -542,117 +2348,186 @@ namespace cs_impl {
 
 		const std::type_info &type() const
 		{
-			return this->mDat != nullptr ? this->mDat->data->type() : typeid(void);
+			const operation_table *ops = get_ops();
+			return ops != nullptr ? *ops->type : typeid(void);
+		}
+
+		// Dense ID of held type, shared by all extensions of current process
+		std::size_t type_id() const
+		{
+			const operation_table *ops = get_ops();
+			return ops != nullptr ? ops->id() : get_type_id<void>();
+		}
+
+		template<typename T>
+		bool is_type_of() const
+		{
+			using type = typename std::remove_cv<typename std::remove_reference<T>::type>::type;
+			return is_type_of<type>(get_ops(), std::is_void<type>());
 		}
 
 		long to_integer() const
 		{
-			if (this->mDat == nullptr)
+			const operation_table *ops = get_ops();
+			if (ops == nullptr)
 				return 0;
-			return this->mDat->data->to_integer();
+			return ops->to_integer(get_data());
 		}
 
 		std::string to_string() const
 		{
-			if (this->mDat == nullptr)
-				return "Null";
-			return this->mDat->data->to_string();
+			std::string str;
+			to_string(str);
+			return str;
+		}
+
+		// Append text of value to a string
+		void to_string(std::string &out) const
+		{
+			const operation_table *ops = get_ops();
+			if (ops == nullptr)
+				out += "Null";
+			else
+				ops->to_string(get_data(), out);
 		}
 
 		std::size_t hash() const
 		{
-			if (this->mDat == nullptr)
+			proxy *dat = mDat.get();
+			std::size_t code = 0;
+			if (dat != nullptr && dat->get_hash(code))
+				return code;
+			const operation_table *ops = get_ops();
+			if (ops == nullptr)
 				return cs_impl::hash<void *>(nullptr);
-			return this->mDat->data->hash();
+			code = ops->hash(get_data());
+			if (dat != nullptr && ops->cache_hash)
+				dat->set_hash(code);
+			return code;
 		}
 
 		void detach() const
 		{
-			if (this->mDat != nullptr) {
-				if (this->mDat->protect_level > 2)
+			if (mDat.is_immediate())
+				mDat.ops()->detach(mDat.data());
+			else if (mDat.usable()) {
+				proxy *dat = mDat.get();
+				if (dat->protect_level() > 2)
 					throw cov::error("E000L");
-				this->mDat->data->detach();
+				if (dat->shared() != nullptr)
+					dat->set(proxy::flag_detach, true);
+				else {
+					dat->own();
+					dat->drop_hash();
+					dat->ops()->detach(dat->data());
+				}
 			}
 		}
 
 		cs::namespace_t &get_ext() const
 		{
-			if (this->mDat == nullptr)
+			const operation_table *ops = get_ops();
+			if (ops == nullptr)
 				throw cs::runtime_error("Type doesn't have extension field.");
-			return this->mDat->data->get_ext();
+			return ops->get_ext();
 		}
 
-		std::string get_type_name() const
+		const std::string &get_type_name() const
 		{
-			if (this->mDat == nullptr)
+			const operation_table *ops = get_ops();
+			if (ops == nullptr)
 				return cxx_demangle(get_name_of_type<void>());
 			else
-				return cxx_demangle(this->mDat->data->get_type_name());
+				return cxx_demangle(ops->get_type_name());
 		}
 
 		bool is_same(const any &obj) const
 		{
-			return this->mDat == obj.mDat;
+			// Immediate values are not shared by other variables
+			return mDat.is_immediate() ? this == &obj : this->mDat == obj.mDat;
 		}
 
 		bool is_rvalue() const
 		{
-			return this->mDat != nullptr && this->mDat->is_rvalue;
+			if (mDat.is_immediate())
+				return mDat.is_rvalue();
+			return mDat.usable() && mDat.get()->is_rvalue();
 		}
 
 		bool is_protect() const
 		{
-			return this->mDat != nullptr && this->mDat->protect_level > 0;
+			return mDat.get() != nullptr && mDat.get()->protect_level() > 0;
 		}
 
 		bool is_constant() const
 		{
-			return this->mDat != nullptr && this->mDat->protect_level > 1;
+			return mDat.get() != nullptr && mDat.get()->protect_level() > 1;
 		}
 
 		bool is_single() const
 		{
-			return this->mDat != nullptr && this->mDat->protect_level > 2;
+			return mDat.get() != nullptr && mDat.get()->protect_level() > 2;
+		}
+
+		// A mutable reference or handle to the payload may still be in use
+		bool is_exposed() const noexcept
+		{
+			return mDat.get() != nullptr && mDat.get()->test(proxy::flag_exposed | proxy::handle_mask);
+		}
+
+		// Mutable references obtained from val<T>() are no longer used, copies may share the payload again
+		void end_borrow() const noexcept
+		{
+			if (mDat.get() != nullptr)
+				mDat.get()->set(proxy::flag_exposed, false);
 		}
 
 		void mark_as_rvalue(bool value) const
 		{
-			if (this->mDat != nullptr)
-				this->mDat->is_rvalue = value;
+			if (mDat.is_immediate()) {
+				if (!mDat.mark_as_rvalue(value))
+					promote()->set_rvalue(value);
+			}
+			else if (mDat.usable())
+				mDat.get()->set_rvalue(value);
 		}
 
 		void protect()
 		{
-			if (this->mDat != nullptr) {
-				if (this->mDat->protect_level > 1)
+			proxy *dat = promote();
+			if (dat != nullptr) {
+				if (dat->protect_level() > 1)
 					throw cov::error("E000G");
-				this->mDat->protect_level = 1;
+				dat->set_protect_level(1);
 			}
 		}
 
 		void constant()
 		{
-			if (this->mDat != nullptr) {
-				if (this->mDat->protect_level > 2)
+			proxy *dat = promote();
+			if (dat != nullptr) {
+				if (dat->protect_level() > 2)
 					throw cov::error("E000G");
-				this->mDat->protect_level = 2;
+				dat->set_protect_level(2);
 			}
 		}
 
 		void single()
 		{
-			if (this->mDat != nullptr) {
-				if (this->mDat->protect_level > 3)
+			proxy *dat = promote();
+			if (dat != nullptr) {
+				if (dat->protect_level() > 3)
 					throw cov::error("E000G");
-				this->mDat->protect_level = 3;
+				dat->set_protect_level(3);
 			}
 		}
 
 		any &operator=(const any &var)
 		{
 			if (!is_same(var)) {
+				proxy *dat = var.duplicate();
 				recycle();
-				mDat = var.duplicate();
+				mDat.set(dat);
 			}
 			return *this;
 		}
@@ -666,7 +2541,29 @@ namespace cs_impl {
 
 		bool compare(const any &var) const
 		{
-			return usable() && var.usable() ? this->mDat->data->compare(var.mDat->data) : !usable() && !var.usable();
+			const operation_table *lhs = get_ops(), *rhs = var.get_ops();
+			if (lhs != nullptr && rhs != nullptr) {
+				if (!lhs->is_same_type(rhs)) {
+					const std::string *a = lhs->text != nullptr ? lhs->text(get_data()) : nullptr;
+					const std::string *b = rhs->text != nullptr ? rhs->text(var.get_data()) : nullptr;
+					return a != nullptr && b != nullptr && *a == *b;
+				}
+				// Boxed numerics are compared with numerics held by proxies by value
+				if (lhs != rhs && (mDat.is_boxed() || var.mDat.is_boxed()))
+					return numeric_value() == var.numeric_value();
+				if (lhs->cache_hash) {
+					// Same payload, or constant payloads with different hash codes
+					proxy *a = mDat.get(), *b = var.mDat.get();
+					std::size_t lhs_code = 0, rhs_code = 0;
+					if (get_data() == var.get_data())
+						return true;
+					if (a != nullptr && b != nullptr && a->get_hash(lhs_code) && b->get_hash(rhs_code) && lhs_code != rhs_code)
+						return false;
+				}
+				return lhs->compare(get_data(), var.get_data());
+			}
+			else
+				return lhs == nullptr && rhs == nullptr;
 		}
 
 		bool operator==(const any &var) const
@@ -682,23 +2579,74 @@ namespace cs_impl {
 		template<typename T>
 		T &val() const
 		{
-			if (typeid(T) != this->type())
+			if (mDat.is_immediate()) {
+				if (!mDat.template holds<T>())
+					throw cov::error("E0006");
+				if (value_word::template referable<T>(true))
+					return holder<T>::data(mDat.data());
+				promote();
+			}
+			proxy *dat = mDat.get();
+			if (dat == nullptr || !dat->ops()->template is_type_of<T>())
 				throw cov::error("E0006");
-			if (this->mDat == nullptr)
-				throw cov::error("E0005");
-			if (this->mDat->protect_level > 1)
+			if (dat->protect_level() > 1)
 				throw cov::error("E000K");
-			return static_cast<holder<T> *>(this->mDat->data)->data();
+			dat->own();
+			dat->drop_hash();
+			dat->set(proxy::flag_exposed, true);
+			return holder<T>::data(dat->data());
 		}
 
 		template<typename T>
 		const T &const_val() const
 		{
-			if (typeid(T) != this->type())
+			if (mDat.is_immediate()) {
+				if (!mDat.template holds<T>())
+					throw cov::error("E0006");
+				if (value_word::template referable<T>(false))
+					return holder<T>::data(static_cast<const void *>(mDat.data()));
+				promote();
+			}
+			proxy *dat = mDat.get();
+			if (dat == nullptr || !dat->ops()->template is_type_of<T>())
 				throw cov::error("E0006");
-			if (this->mDat == nullptr)
-				throw cov::error("E0005");
-			return static_cast<holder<T> *>(this->mDat->data)->data();
+			return holder<T>::data(static_cast<const void *>(dat->payload()));
+		}
+
+		/*
+		* Unchecked access for types already checked by caller.
+		* Null, type and protect level are only asserted in debug builds.
+		*/
+		template<typename T>
+		T &unchecked_val() const
+		{
+			assert(is_type_of<T>() && !is_constant());
+			if (mDat.is_immediate()) {
+				if (value_word::template referable<T>(true))
+					return holder<T>::data(mDat.data());
+				promote();
+			}
+			proxy *dat = mDat.get();
+			dat->own();
+			dat->drop_hash();
+			dat->set(proxy::flag_exposed, true);
+			return holder<T>::data(dat->data());
+		}
+
+		template<typename T>
+		const T &unchecked_const_val() const
+		{
+			assert(is_type_of<T>());
+			if (mDat.is_immediate() && !value_word::template referable<T>(false))
+				promote();
+			return holder<T>::data(static_cast<const void *>(get_data()));
+		}
+
+		// Copy of a numeric, boxed numerics are decoded instead of promoted. Type is only asserted in debug builds.
+		cs::numeric numeric_value() const
+		{
+			assert(is_type_of<cs::numeric>());
+			return mDat.is_boxed() ? mDat.load_numeric() : holder<cs::numeric>::data(static_cast<const void *>(get_data()));
 		}
 
 		template<typename T>
@@ -709,19 +2657,26 @@ namespace cs_impl {
 
 		void assign(const any &obj, bool raw = false)
 		{
-			if (&obj != this && obj.mDat != mDat) {
-				if (mDat != nullptr && obj.mDat != nullptr && raw) {
-					if (mDat->is_rvalue || this->mDat->protect_level > 0 || obj.mDat->protect_level > 0)
+			if (!is_same(obj)) {
+				proxy *dat = mDat.get();
+				if (dat != nullptr && obj.usable() && raw) {
+					if (dat->is_rvalue() || dat->protect_level() > 0 || obj.is_protect())
 						throw cov::error("E000J");
-					mDat->data->kill();
-					mDat->data = obj.mDat->data->duplicate();
+					const operation_table *ops = obj.get_ops();
+					if (dat->test(proxy::flag_lent))
+						dat->reclaim();
+					dat->release();
+					dat->set(proxy::flag_exposed, false);
+					dat->set_data(ops->duplicate_to(obj.get_data(), dat->buffer(), dat->capacity()));
+					dat->set_ops(ops);
 				}
 				else {
+					// Immediate values have no other references, replacing them is the same as writing in place
+					if (mDat.is_immediate() && obj.usable() && raw && (is_rvalue() || obj.is_protect()))
+						throw cov::error("E000J");
+					value_word word = obj.copy_value();
 					recycle();
-					if (obj.mDat != nullptr)
-						mDat = allocator.alloc(1, obj.mDat->data->duplicate());
-					else
-						mDat = nullptr;
+					mDat = word;
 				}
 			}
 		}
@@ -729,16 +2684,20 @@ namespace cs_impl {
 		template<typename T>
 		void assign(const T &dat, bool raw = false)
 		{
-			if (mDat != nullptr && raw) {
-				if (mDat->is_rvalue || this->mDat->protect_level > 0)
-					throw cov::error("E000J");
-				mDat->data->kill();
-				mDat->data = holder<T>::allocator.alloc(dat);
-			}
-			else {
-				recycle();
-				mDat = allocator.alloc(1, holder<T>::allocator.alloc(dat));
-			}
+			replace<T>(raw, dat);
+		}
+
+		template<typename T, typename = typename std::enable_if<is_movable_t<T>::value>::type>
+		void assign(T &&dat, bool raw = false)
+		{
+			replace<T>(raw, std::move(dat));
+		}
+
+		// Construct a new value of type T from arguments in place of current one
+		template<typename T, typename...ArgsT>
+		void emplace(ArgsT &&...args)
+		{
+			replace<T>(false, std::forward<ArgsT>(args)...);
 		}
 
 		template<typename T>
@@ -747,6 +2706,110 @@ namespace cs_impl {
 			assign(dat);
 			return *this;
 		}
+
+		template<typename T, typename = typename std::enable_if<is_movable_t<T>::value>::type>
+		any &operator=(T &&dat)
+		{
+			assign(std::move(dat));
+			return *this;
+		}
+	};
+
+	/*
+	* Typed handle of variable
+	* Checks the type once and keeps a pointer to the value. It must not outlive the variable and
+	* is invalidated by raw assign and raw swap. The variable caches no hash code and copies of it take
+	* their own payload as long as the handle lives.
+	* any_handle<const T> only needs read access and does not check protect level, on a copy it is
+	* also invalidated once the copy or its source is written.
+	*/
+	template<typename T>
+	class any_handle final {
+		T *m_ptr;
+		// Proxy of the payload, immediate values have none
+		any::proxy *m_dat;
+
+		void hold() const noexcept
+		{
+			if (m_dat != nullptr) {
+				m_dat->refcount.increase();
+				m_dat->hold();
+			}
+		}
+
+	public:
+		explicit any_handle(const any &val) : m_ptr(nullptr), m_dat(nullptr)
+		{
+			// The handle stands in for the reference it is made of
+			bool exposed = val.mDat.get() != nullptr && val.mDat.get()->test(any::proxy::flag_exposed);
+			m_ptr = &val.val<T>();
+			m_dat = val.mDat.get();
+			if (m_dat != nullptr && !exposed)
+				m_dat->set(any::proxy::flag_exposed, false);
+			hold();
+		}
+
+		any_handle(const any_handle &handle) noexcept : m_ptr(handle.m_ptr), m_dat(handle.m_dat)
+		{
+			hold();
+		}
+
+		any_handle &operator=(const any_handle &handle) noexcept
+		{
+			if (this != &handle) {
+				handle.hold();
+				this->~any_handle();
+				m_ptr = handle.m_ptr;
+				m_dat = handle.m_dat;
+			}
+			return *this;
+		}
+
+		~any_handle()
+		{
+			if (m_dat != nullptr) {
+				m_dat->unhold();
+				any::release_reference(m_dat);
+			}
+		}
+
+		T &get() const noexcept
+		{
+			return *m_ptr;
+		}
+
+		T &operator*() const noexcept
+		{
+			return *m_ptr;
+		}
+
+		T *operator->() const noexcept
+		{
+			return m_ptr;
+		}
+	};
+
+	template<typename T>
+	class any_handle<const T> final {
+		const T *m_ptr;
+	public:
+		// Immediate values are promoted, the word itself changes once the variable is copied
+		explicit any_handle(const any &val) : m_ptr((val.promote(), &val.const_val<T>())) {}
+
+		const T &get() const noexcept
+		{
+			return *m_ptr;
+		}
+
+		const T &operator*() const noexcept
+		{
+			return *m_ptr;
+		}
+
+		const T *operator->() const noexcept
+		{
+			return m_ptr;
+		}
 	};
 
 	template<>
@@ -777,6 +2840,12 @@ namespace cs_impl {
 	};
 
 	template<typename T> default_allocator<any::holder<T>> any::holder<T>::allocator;
+
+	template<typename T> constexpr any::operation_table any::holder<T>::ops;
+
+	template<typename T> constexpr any::operation_table any::boxed<T>::ops;
+
+	template<std::size_t N> cs::allocator_type<any::proxy_block<N>, default_allocate_buffer_size*default_allocate_buffer_multiplier, default_allocator_provider> any::proxy_block<N>::allocator;
 }
 
 std::ostream &operator<<(std::ostream &, const cs_impl::any &);
@@ -790,3 +2859,42 @@ namespace std {
 		}
 	};
 }
+
+namespace cs_impl {
+// Tracing of containers of variables
+	template<>
+	struct var_tracer<cs::array> : var_container_tracer<cs::array> {
+	};
+
+	template<>
+	struct var_tracer<cs::list> : var_container_tracer<cs::list> {
+	};
+
+	template<>
+	struct var_tracer<cs::vector> : var_container_tracer<cs::vector> {
+	};
+
+	template<>
+	struct var_tracer<cs::hash_set> : var_container_tracer<cs::hash_set> {
+	};
+
+	template<>
+	struct var_tracer<cs::hash_map> : var_container_tracer<cs::hash_map> {
+		static void trace(const cs::hash_map &dat, void (*visit)(const any &, void *), void *ctx)
+		{
+			for (auto &it: dat) {
+				visit(it.first, ctx);
+				visit(it.second, ctx);
+			}
+		}
+	};
+
+	template<>
+	struct var_tracer<cs::pair> : var_container_tracer<cs::pair> {
+		static void trace(const cs::pair &dat, void (*visit)(const any &, void *), void *ctx)
+		{
+			visit(dat.first, ctx);
+			visit(dat.second, ctx);
+		}
+	};
+}
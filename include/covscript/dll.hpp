@@ -34,9 +34,15 @@ extern "C"
 	{
 		return COVSCRIPT_ABI_VERSION;
 	}
+	int __CS_ABI_LAYOUT__()
+	{
+		return cs::dll_resources::abi_layout();
+	}
 	void __CS_EXTENSION_MAIN__(cs::name_space *ext, cs::process_context *context)
 	{
 		cs::current_process = context;
+		cs_impl::reset_type_ids();
+		cs_impl::reset_statistics();
 		cs_extension_main(ext);
 	}
 }
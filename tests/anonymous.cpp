@@ -0,0 +1,19 @@
+#include <covscript/covscript.hpp>
+
+// Same name as a type of tests/main.cpp, but a different type
+namespace {
+	struct local_value {
+		double x = 0.5;
+		double y = 1.5;
+	};
+}
+
+cs::var make_anonymous_value()
+{
+	return cs::var::make<local_value>();
+}
+
+bool is_anonymous_value(const cs::var &val)
+{
+	return val.is_type_of<local_value>();
+}
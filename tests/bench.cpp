@@ -0,0 +1,204 @@
+#include <covscript/covscript.hpp>
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <algorithm>
+#include <numeric>
+#include <random>
+
+#ifdef __linux__
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#endif
+
+constexpr std::size_t bench_rounds = 10000000;
+
+template<typename T>
+void bench(const char *name, T &&func)
+{
+	std::size_t result = 0;
+	auto begin = std::chrono::steady_clock::now();
+	for (std::size_t i = 0; i < bench_rounds; ++i)
+		result += func();
+	auto end = std::chrono::steady_clock::now();
+	double ns = std::chrono::duration<double, std::nano>(end - begin).count() / bench_rounds;
+	std::cout << std::left << std::setw(40) << name << std::fixed << std::setprecision(2) << ns << " ns/op"
+	          << (result == bench_rounds ? "" : " (mismatch)") << std::endl;
+}
+
+// Load misses of the data TLB in current thread, unavailable without permission to read hardware counters
+class tlb_counter final {
+	int fd = -1;
+public:
+	tlb_counter()
+	{
+#ifdef __linux__
+		perf_event_attr attr{};
+		attr.size = sizeof(attr);
+		attr.type = PERF_TYPE_HW_CACHE;
+		attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+		if (fd >= 0)
+			ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+	}
+
+	tlb_counter(const tlb_counter &) = delete;
+
+	~tlb_counter()
+	{
+#ifdef __linux__
+		if (fd >= 0)
+			close(fd);
+#endif
+	}
+
+	void report()
+	{
+		long long count = 0;
+#ifdef __linux__
+		if (fd >= 0 && read(fd, &count, sizeof(count)) == sizeof(count)) {
+			std::cout << std::left << std::setw(40) << "  dTLB load misses" << std::fixed << std::setprecision(2)
+			          << double(count) / bench_rounds << " /op" << std::endl;
+			return;
+		}
+#endif
+		std::cout << std::left << std::setw(40) << "  dTLB load misses" << "unavailable" << std::endl;
+	}
+};
+
+int main(int argc, const char **args)
+{
+	if (argc != 2)
+		return -1;
+	cs::extension dll(args[1]);
+	// Created in the extension, so it refers to the type_info and operation table of another module
+	cs::var remote_var = dll.get_var("number");
+	cs::var local_var = cs::numeric(0);
+	// Reload through volatile pointers to keep the checks inside of loops
+	cs::var *volatile remote = &remote_var;
+	cs::var *volatile local = &local_var;
+	std::cout << "Type check" << std::endl;
+	bench("type_info, same module", [&] {
+		return typeid(cs::numeric) == local->type();
+	});
+	bench("type_info, cross module", [&] {
+		return typeid(cs::numeric) == remote->type();
+	});
+	bench("type id, same module", [&] {
+		return local->is_type_of<cs::numeric>();
+	});
+	bench("type id, cross module", [&] {
+		return remote->is_type_of<cs::numeric>();
+	});
+	std::cout << "Typed access" << std::endl;
+	bench("const_val, cross module", [&] {
+		return remote->const_val<cs::numeric>() == 0;
+	});
+	bench("unchecked_const_val, cross module", [&] {
+		return remote->unchecked_const_val<cs::numeric>() == 0;
+	});
+	cs::var_handle<const cs::numeric> handle(remote_var);
+	const cs::var_handle<const cs::numeric> *volatile handle_ptr = &handle;
+	bench("handle, cross module", [&] {
+		return **handle_ptr == 0;
+	});
+#ifdef COVSCRIPT_VAR_COMPACT
+	std::cout << "Variable (compact)" << std::endl;
+#else
+	std::cout << "Variable (proxy)" << std::endl;
+#endif
+	volatile int seed = 1;
+	bench("bool temporary", [&] {
+		cs::var val = seed > 0;
+		return val.const_val<bool>();
+	});
+	bench("double arithmetic", [&] {
+		cs::var lhs = 1.5 * seed, rhs = 2.0;
+		cs::var val = lhs.const_val<double>() + rhs.const_val<double>();
+		return val.const_val<double>() == 3.5;
+	});
+	bench("int copy", [&] {
+		cs::var val = seed;
+		cs::var dup = cs::copy(val);
+		return dup.const_val<int>() == 1;
+	});
+	cs::var array = cs::var::make<cs::array>();
+	for (int i = 0; i < 100; ++i)
+		array.val<cs::array>().push_back(cs::numeric(i));
+	// Populated like a native function would, the reference is not used after the call
+	array.end_borrow();
+	bench("array copy, 100 elements", [&] {
+		cs::var dup = cs::copy(array);
+		return dup.const_val<cs::array>().size() == 100;
+	});
+	bench("numeric arithmetic", [&] {
+		cs::var lhs = cs::numeric(seed), rhs = cs::numeric(2);
+		cs::var val = lhs.const_val<cs::numeric>() + rhs.const_val<cs::numeric>();
+		return val.const_val<cs::numeric>() == 3;
+	});
+	bench("numeric arithmetic, by value", [&] {
+		cs::var lhs = cs::numeric(seed), rhs = cs::numeric(2);
+		cs::var val = lhs.numeric_value() + rhs.numeric_value();
+		return val.numeric_value() == 3;
+	});
+	{
+		cs::process_context::arena_scope arena;
+		bench("numeric arithmetic, arena", [&] {
+			cs::var lhs = cs::numeric(seed), rhs = cs::numeric(2);
+			cs::var val = lhs.const_val<cs::numeric>() + rhs.const_val<cs::numeric>();
+			return val.const_val<cs::numeric>() == 3;
+		});
+	}
+#ifdef COVSCRIPT_SLAB_HUGEPAGE
+	std::cout << "Pointer chasing (huge pages)" << std::endl;
+#else
+	std::cout << "Pointer chasing" << std::endl;
+#endif
+	{
+		// Each variable holds the index of the next one in a random cycle through all of them
+		constexpr std::size_t chase_size = 1 << 20;
+		std::vector<std::size_t> order(chase_size), next(chase_size);
+		std::iota(order.begin(), order.end(), 0);
+		std::shuffle(order.begin() + 1, order.end(), std::mt19937(42));
+		for (std::size_t i = 0; i < chase_size; ++i)
+			next[order[i]] = order[(i + 1) % chase_size];
+		std::vector<cs::var> nodes;
+		nodes.reserve(chase_size);
+		for (std::size_t i = 0; i < chase_size; ++i)
+			nodes.push_back(cs::numeric(next[i]));
+		std::size_t cursor = 0;
+		tlb_counter tlb;
+		bench("pointer chasing, 1M variables", [&] {
+			cursor = nodes[cursor].const_val<cs::numeric>().as_integer();
+			return cursor < chase_size;
+		});
+		tlb.report();
+	}
+	std::cout << "Hash map" << std::endl;
+	cs::hash_map map;
+	cs::var key = cs::var::make_constant<cs::string>(std::string(256, 'k'));
+	map.emplace(key, cs::numeric(1));
+	bench("lookup, long string key", [&] {
+		return map.count(key);
+	});
+	std::cout << "To string" << std::endl;
+	cs::var integer = 123456789l;
+	bench("to_string, long", [&] {
+		return integer.to_string().size() == 9;
+	});
+	std::string buffer;
+	bench("to_string append, long", [&] {
+		buffer.clear();
+		integer.to_string(buffer);
+		return buffer.size() == 9;
+	});
+	return 0;
+}
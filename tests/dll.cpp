@@ -8,4 +8,24 @@ CNI_ROOT_NAMESPACE {
 		std::cout << str << std::endl;
 	}
 	CNI(print)
+
+	// Pools of the process as seen by the extension
+	cs::pool_allocator *pool_allocator()
+	{
+		return cs::pool_allocator::current();
+	}
+	CNI(pool_allocator)
+
+	cs::slab_heap *slab_heap()
+	{
+		return cs::slab_heap::current();
+	}
+	CNI(slab_heap)
+
+	cs::var make_array()
+	{
+		return cs::var::make<cs::array>(cs::array{cs::numeric(1), cs::numeric(2)});
+	}
+	CNI(make_array)
+	CNI_VALUE(number, cs::numeric(0))
 }
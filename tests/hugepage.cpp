@@ -0,0 +1,107 @@
+#include <covscript/covscript.hpp>
+#include <sys/resource.h>
+#include <iostream>
+#include <fstream>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <unistd.h>
+
+static int failures = 0;
+
+static void check(bool cond, const char *what)
+{
+	if (!cond) {
+		std::cerr << "Failed: " << what << std::endl;
+		++failures;
+	}
+}
+
+static std::uintptr_t region_of(const void *ptr)
+{
+	return reinterpret_cast<std::uintptr_t>(ptr) & ~std::uintptr_t(cs::slab_heap::region_size - 1);
+}
+
+static bool slab_aligned(const void *ptr)
+{
+	return (reinterpret_cast<std::uintptr_t>(ptr) & (cs::slab_heap::slab_size - 1)) == 0;
+}
+
+static void test_regions()
+{
+	// Slabs are carved from regions, a region holds region_size / slab_size slabs
+	constexpr std::size_t per_region = cs::slab_heap::region_size / cs::slab_heap::slab_size;
+	cs::slab_heap heap;
+	std::vector<void *> slabs;
+	for (std::size_t i = 0; i <= per_region; ++i) {
+		slabs.push_back(heap.acquire_slab());
+		std::memset(slabs.back(), 0xAB, cs::slab_heap::slab_size);
+	}
+	bool aligned = true;
+	for (void *ptr: slabs)
+		aligned = aligned && slab_aligned(ptr);
+	check(aligned, "slabs of regions are aligned to their size");
+	check(region_of(slabs.front()) == region_of(slabs[per_region - 1]), "slabs share a region until it is full");
+	check(region_of(slabs.front()) != region_of(slabs.back()), "full regions are followed by a new one");
+	check(heap.regions() == 2, "two regions hold the slabs");
+
+	// Slabs returned to the system leave their region mapped until all of its slabs are returned
+	for (void *ptr: slabs)
+		heap.release_slab(ptr);
+	check(heap.regions() > 0, "cached slabs keep their region");
+	void *reused = heap.acquire_slab();
+	heap.release_slab(reused);
+	check(heap.trim() == cs::slab_heap::cached_slabs, "trim returns cached slabs");
+	check(heap.regions() == 0, "regions are unmapped once all of their slabs are returned");
+
+	// Small objects live in slabs of regions as well
+	void *block = heap.allocate(cs::slab_heap::granularity);
+	check(heap.regions() == 1, "allocations map a region");
+	cs::slab_heap::deallocate(block);
+	heap.trim();
+	check(heap.regions() == 0, "trimmed heaps unmap their regions");
+}
+
+// Pages mapped by current process
+static std::size_t mapped_bytes()
+{
+	std::ifstream statm("/proc/self/statm");
+	std::size_t pages = 0;
+	statm >> pages;
+	return pages * sysconf(_SC_PAGESIZE);
+}
+
+static void test_fallback()
+{
+	// Leave too little address space for a region, slabs are mapped one at a time instead
+	rlimit saved;
+	getrlimit(RLIMIT_AS, &saved);
+	rlimit limited = saved;
+	limited.rlim_cur = mapped_bytes() + cs::slab_heap::region_size / 2;
+	if (setrlimit(RLIMIT_AS, &limited) != 0) {
+		std::cerr << "Skipped fallback of huge pages: address space can not be limited" << std::endl;
+		return;
+	}
+	cs::slab_heap heap;
+	void *slab = nullptr;
+	try {
+		slab = heap.acquire_slab();
+	}
+	catch (const std::bad_alloc &) {
+	}
+	bool fell_back = slab != nullptr && heap.regions() == 0 && slab_aligned(slab);
+	if (slab != nullptr) {
+		std::memset(slab, 0xAB, cs::slab_heap::slab_size);
+		heap.release_slab(slab);
+	}
+	heap.trim();
+	setrlimit(RLIMIT_AS, &saved);
+	check(fell_back, "slabs are mapped on their own if regions can not be mapped");
+}
+
+int main()
+{
+	test_regions();
+	test_fallback();
+	return failures != 0 ? -1 : 0;
+}
@@ -1,13 +1,750 @@
 #include <covscript/covscript.hpp>
+#include <iostream>
+#include <sstream>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+static int failures = 0;
+
+// Defined in tests/anonymous.cpp
+cs::var make_anonymous_value();
+
+bool is_anonymous_value(const cs::var &);
+
+static void check(bool cond, const char *what)
+{
+	if (!cond) {
+		std::cerr << "Failed: " << what << std::endl;
+		++failures;
+	}
+}
+
+// Too large to be held in the block of a proxy
+struct large_value {
+	int x = 0;
+	char padding[256] = {};
+};
+
+static cs::var make_array()
+{
+	return cs::var::make<cs::array>(cs::array{cs::numeric(1), cs::numeric(2)});
+}
+
+static std::size_t size_of(const cs::var &val)
+{
+	return val.const_val<cs::array>().size();
+}
+
+static void test_copy_on_write()
+{
+	// Copies and their source are written independently
+	cs::var a = make_array();
+	cs::var b = cs::copy(a);
+	// Variables shared between threads are copied right away
+	if (!cs_impl::default_refcount::concurrent)
+		check(&a.const_val<cs::array>() == &b.const_val<cs::array>(), "copies share the payload until written");
+	b.val<cs::array>().push_back(cs::numeric(3));
+	check(size_of(a) == 2 && size_of(b) == 3, "writing a copy leaves its source unchanged");
+	cs::var c = cs::copy(a);
+	a.val<cs::array>().push_back(cs::numeric(3));
+	check(size_of(a) == 3 && size_of(c) == 2, "writing the source leaves its copies unchanged");
+	cs::var d = cs::copy(c), e = cs::copy(d);
+	d.val<cs::array>().clear();
+	check(size_of(c) == 2 && size_of(d) == 0 && size_of(e) == 2, "copies of copies are independent");
+
+	// References obtained from the source stay valid and keep referring to it
+	cs::var f = make_array();
+	const cs::array &ref = f.const_val<cs::array>();
+	cs::var g = cs::copy(f);
+	check(&ref == &f.const_val<cs::array>(), "copying keeps the payload of the source in place");
+	f.val<cs::array>().push_back(cs::numeric(3));
+	check(ref.size() == 3 && size_of(g) == 2, "writing the source after copying keeps its references valid");
+
+	// Writes through references obtained before copying do not reach the copy
+	cs::var h = make_array();
+	cs::array &arr = h.val<cs::array>();
+	cs::var i = cs::copy(h);
+	arr.push_back(cs::numeric(3));
+	check(size_of(h) == 3 && size_of(i) == 2, "writing through an earlier reference leaves copies unchanged");
+
+	cs::var j = cs::var::make<large_value>();
+	cs::var_handle<large_value> handle(j);
+	cs::var k = cs::copy(j);
+	handle->x = 42;
+	check(j.const_val<large_value>().x == 42 && k.const_val<large_value>().x == 0, "writing through a handle leaves copies unchanged");
+	cs::var l = cs::copy(k);
+	k.val<large_value>().x = 7;
+	check(k.const_val<large_value>().x == 7 && l.const_val<large_value>().x == 0, "writing an out of line copy leaves its source unchanged");
+
+	// The last reader takes over the payload
+	cs::var m = make_array();
+	cs::var n = cs::copy(m);
+	m = cs::numeric(0);
+	n.val<cs::array>().push_back(cs::numeric(3));
+	check(size_of(n) == 3, "a copy outliving its source keeps the payload");
+}
+
+static void push_three(cs::array &arr)
+{
+	arr.push_back(cs::numeric(3));
+}
+
+static void test_borrowing()
+{
+	// Variables shared between threads are never lent, their copies share a duplicate
+	bool lent = !cs_impl::default_refcount::concurrent;
+
+	// Mutable references bound to arguments end with the call
+	cs::var a = make_array();
+	cs::cni push(push_three);
+	cs::vector args{a};
+	push(args);
+	check(size_of(a) == 3 && !a.is_exposed(), "calls end borrowing of their arguments");
+	cs::var b = cs::copy(a);
+	if (lent)
+		check(&a.const_val<cs::array>() == &b.const_val<cs::array>(), "written arguments are shared after the call");
+
+	// References obtained before the call are still in use
+	cs::var c = make_array();
+	cs::array &ref = c.val<cs::array>();
+	cs::vector more{c};
+	push(more);
+	check(c.is_exposed(), "calls leave earlier borrowing alone");
+	cs::var d = cs::copy(c);
+	ref.push_back(cs::numeric(4));
+	check(size_of(c) == 4 && size_of(d) == 3, "references obtained before a call keep writing the source only");
+	c.end_borrow();
+	cs::var e = cs::copy(c);
+	if (lent)
+		check(&c.const_val<cs::array>() == &e.const_val<cs::array>(), "ended borrowing lets copies share again");
+
+	// Handles hold the payload until they are gone
+	cs::var f = make_array();
+	{
+		cs::var_handle<cs::array> handle(f);
+		cs::var_handle<cs::array> other(handle);
+		check(f.is_exposed(), "handles expose the payload");
+		cs::var g = cs::copy(f);
+		handle->push_back(cs::numeric(3));
+		other->push_back(cs::numeric(4));
+		check(size_of(f) == 4 && size_of(g) == 2, "writing through handles leaves copies unchanged");
+	}
+	check(!f.is_exposed(), "releasing handles ends borrowing");
+	cs::var h = cs::copy(f);
+	if (lent)
+		check(&f.const_val<cs::array>() == &h.const_val<cs::array>(), "copies share again once handles are gone");
+
+	// Copies of a copy share one payload, even if the source was never lent
+	cs::var i = make_array();
+	i.val<cs::array>();
+	cs::var j = cs::copy(i), k = cs::copy(j);
+	check(&j.const_val<cs::array>() != &i.const_val<cs::array>(), "exposed payloads are not lent");
+	check(&j.const_val<cs::array>() == &k.const_val<cs::array>(), "copies of a copy share the payload");
+	k.val<cs::array>().clear();
+	check(size_of(i) == 2 && size_of(j) == 2 && size_of(k) == 0, "copies of a copy are written independently");
+}
+
+// Copies and moves throw on demand
+static bool copies_throw = false;
+
+struct throwing_value {
+	int x = 0;
+
+	explicit throwing_value(int val) : x(val) {}
+
+	throwing_value(const throwing_value &val) : x(val.x)
+	{
+		if (copies_throw)
+			throw std::runtime_error("copy");
+	}
+
+	throwing_value(throwing_value &&val) noexcept(false) : x(val.x)
+	{
+		if (copies_throw)
+			throw std::runtime_error("move");
+	}
+};
+
+static void test_raw_swap()
+{
+	// Payloads with throwing moves are exchanged without being moved
+	cs::var a = cs::var::make<throwing_value>(1), b = cs::var::make<std::string>("text"), c = cs::var::make<throwing_value>(2);
+	copies_throw = true;
+	bool thrown = false;
+	try {
+		a.swap(b, true);
+		b.swap(c, true);
+	}
+	catch (...) {
+		thrown = true;
+	}
+	copies_throw = false;
+	check(!thrown, "raw swap does not move payloads with throwing moves");
+	check(a.const_val<std::string>() == "text" && b.const_val<throwing_value>().x == 2 && c.const_val<throwing_value>().x == 1, "raw swap exchanges payloads with throwing moves");
+	check(a.to_string() == "text", "raw swap leaves proxies usable");
+
+	// Holders in blocks of different sizes
+	cs::var d = cs::numeric(1), e = make_array();
+	d.swap(e, true);
+	check(size_of(d) == 2 && e.const_val<cs::numeric>() == 1, "raw swap exchanges payloads of different sizes");
+}
+
+// Counts copies of payloads
+static int payload_copies = 0;
+
+struct copy_counting {
+	std::vector<int> data{1, 2, 3};
+
+	copy_counting() = default;
+
+	copy_counting(const copy_counting &other) : data(other.data)
+	{
+		++payload_copies;
+	}
+
+	copy_counting(copy_counting &&) = default;
+
+	copy_counting &operator=(const copy_counting &other)
+	{
+		data = other.data;
+		++payload_copies;
+		return *this;
+	}
+
+	copy_counting &operator=(copy_counting &&) = default;
+};
+
+static copy_counting make_counting()
+{
+	return copy_counting();
+}
+
+static void test_moved_payloads()
+{
+	payload_copies = 0;
+	cs::var a(copy_counting{});
+	check(payload_copies == 0, "rvalues are moved into new variables");
+	a.assign(copy_counting{});
+	a = copy_counting{};
+	check(payload_copies == 0, "rvalues are moved into assigned variables");
+	a.emplace<copy_counting>();
+	check(payload_copies == 0, "emplace constructs in place");
+	copy_counting value;
+	cs::var b = std::move(value);
+	check(payload_copies == 0 && b.const_val<copy_counting>().data.size() == 3, "moved lvalues are not copied");
+	cs::var c(b.const_val<copy_counting>());
+	check(payload_copies == 1, "lvalues are copied");
+
+	// Results of native functions are moved into their variables
+	payload_copies = 0;
+	cs::cni make(make_counting);
+	cs::vector none;
+	cs::var result = make(none);
+	check(payload_copies == 0 && result.const_val<copy_counting>().data.size() == 3, "returned values are moved");
+}
+
+static void test_immediate_values()
+{
+	// Numerics round trip whether they are boxed or held by a proxy
+	cs::var small = cs::numeric(3), large = cs::numeric(1ll << 40), half = cs::numeric(0.5), tenth = cs::numeric(0.1l);
+	check(small.const_val<cs::numeric>().is_integer() && small.const_val<cs::numeric>() == 3, "small integers keep their value");
+	check(large.const_val<cs::numeric>().as_integer() == 1ll << 40, "large integers keep their value");
+	check(half.const_val<cs::numeric>().is_float() && half.const_val<cs::numeric>() == 0.5, "floats keep their value");
+	check(tenth.const_val<cs::numeric>().as_float() == 0.1l, "floats of extended precision keep their value");
+
+	// Values compare and hash alike whatever holds them
+	cs::var boxed = cs::numeric(5), held = cs::numeric(5);
+	held.val<cs::numeric>();
+	check(boxed == held && held == boxed, "numerics compare by value");
+	check(boxed.to_string() == held.to_string(), "numerics convert to the same text");
+	check(boxed.type() == typeid(cs::numeric) && boxed.is_type_of<cs::numeric>(), "numerics report their type");
+
+	// NaNs written in place can't be mistaken for anything but a double
+	cs::var dbl = 1.0;
+	std::uint64_t bits = 0xFFF9000000001234ull;
+	std::memcpy(&dbl.val<double>(), &bits, sizeof(bits));
+	cs::var other = dbl;
+	check(dbl.type() == typeid(double) && std::isnan(other.const_val<double>()), "NaNs written in place stay doubles");
+
+	// References and handles outlive copies and protection of the variable
+	cs::var a = 5;
+	int &ref = a.val<int>();
+	cs::var b = a;
+	ref = 7;
+	check(a.const_val<int>() == 7 && b.const_val<int>() == 7, "writing through a reference taken before copying");
+	cs::var c = 1;
+	int &prot = c.val<int>();
+	c.protect();
+	prot = 3;
+	check(c.const_val<int>() == 3, "writing through a reference taken before protecting");
+	cs::var d = true;
+	cs::var_handle<const bool> handle(d);
+	cs::var e = d;
+	check(*handle && e.const_val<bool>(), "reading through a handle taken before copying");
+}
+
+static void test_hash_cache()
+{
+	// Writes through references obtained before hashing are seen by comparisons
+	cs::var a = cs::var::make<std::string>("a"), b = cs::var::make<std::string>("b");
+	std::string &ref = a.val<std::string>();
+	a.hash();
+	b.hash();
+	ref = "b";
+	check(a == b && a.hash() == b.hash(), "mutable strings are hashed again after writes");
+
+	// Constants keep their hash code and still compare by value
+	cs::var c = cs::var::make_constant<std::string>("c"), d = cs::var::make_constant<std::string>("c"), e = cs::var::make_constant<std::string>("e");
+	check(c.hash() == d.hash() && c.hash() == c.hash(), "constants keep their hash code");
+	check(c == d && !(c == e), "constants compare by value");
+}
+
+static void test_symbol_lookup()
+{
+	// Looking names up neither interns them nor takes the lock of the pool
+	cs::string_pool *pool = cs::string_pool::current();
+	cs::domain_type domain;
+	domain.add_var("lookup_defined", cs::numeric(1));
+	std::size_t size = pool->size();
+	bool thrown = false;
+	try {
+		domain.get_var("lookup_undefined");
+	}
+	catch (const cs::runtime_error &) {
+		thrown = true;
+	}
+	check(thrown && !domain.exist("lookup_undefined") && pool->size() == size, "undefined names are not interned by lookups");
+	check(domain.exist("lookup_defined") && domain.get_var(cs::var_id("lookup_defined")).const_val<cs::numeric>() == 1, "names are found by content and by id");
+
+	// Interned strings are only passed to native functions by value or constant reference
+	cs::var symbol = cs::var::make<cs::interned_string>("symbol");
+	check(cs_impl::try_convert<const cs::string &, const cs::string &, 0>::convert(symbol) == "symbol", "interned strings are passed by constant reference");
+	thrown = false;
+	try {
+		cs_impl::try_convert<cs::string &, cs::string &, 0>::convert(symbol);
+	}
+	catch (const cs::runtime_error &) {
+		thrown = true;
+	}
+	check(thrown, "interned strings are not passed by non-constant reference");
+
+	// Interned strings and strings of the same text are the same key
+	cs::var text = cs::var::make<cs::string>("symbol");
+	check(symbol == text && text == symbol && symbol.hash() == text.hash(), "interned strings equal strings of the same text");
+	check(!(symbol == cs::var::make<cs::string>("other")), "interned strings differ from strings of other text");
+	check(cs::var::make<cs::interned_string>("").hash() == cs::var::make<cs::string>("").hash(), "empty interned strings hash like empty strings");
+	cs::hash_map map;
+	map.emplace(symbol, cs::numeric(1));
+	check(map.count(text) == 1 && map.emplace(text, cs::numeric(2)).second == false, "interned strings and strings find each other in hash maps");
+
+	// Ids written in place are interned again by the next lookup
+	domain.add_var("lookup_renamed", cs::numeric(2));
+	cs::var_id id("lookup_defined");
+	check(domain.get_var(id).const_val<cs::numeric>() == 1, "ids are found before renaming");
+	static_cast<std::string &>(id) = "lookup_renamed";
+	check(id.get_id() == "lookup_renamed" && domain.get_var(id).const_val<cs::numeric>() == 2, "ids written in place find the new name");
+	cs::var_id copied(id);
+	static_cast<std::string &>(id) += "_again";
+	check(copied.get_id() == "lookup_renamed" && !domain.exist(id), "copies of ids keep their own name");
+}
+
+namespace {
+	struct local_value {
+		int x = 1;
+	};
+}
+
+static void test_type_ids()
+{
+	// Types with internal linkage of different translation units share their mangled name
+	cs::var local = cs::var::make<local_value>(), other = make_anonymous_value();
+	check(local.is_type_of<local_value>() && is_anonymous_value(other), "types with internal linkage are recognized");
+	check(!other.is_type_of<local_value>() && !is_anonymous_value(local), "types with internal linkage of other translation units are told apart");
+	check(!(local == other), "types with internal linkage of other translation units never compare equal");
+}
+
+static void test_memory_budget()
+{
+	// Threads keep credit of the budget, so it must outlive them
+	static cs::memory_budget budget;
+	cs::memory_budget *prev = cs::current_process->var_budget;
+	cs::current_process->var_budget = &budget;
+	budget.set_limit(1 << 20);
+	bool raised = false;
+	{
+		std::vector<cs::var> vars;
+		try {
+			for (std::size_t i = 0; i < (1 << 20); ++i)
+				vars.push_back(cs::var::make<large_value>());
+		}
+		catch (const cs::runtime_error &) {
+			raised = true;
+		}
+		check(raised && !vars.empty(), "going over the budget raises a runtime error");
+		check(budget.used() <= budget.limit(), "charges stay within the budget");
+	}
+	// Released variables return their charge, cached blocks are not charged
+	cs::var val = cs::var::make<large_value>();
+	val.val<large_value>().x = 1;
+	check(val.const_val<large_value>().x == 1 && budget.used() < budget.limit() / 2, "variables are usable after going over the budget");
+	budget.set_limit(0);
+	cs::current_process->var_budget = prev;
+}
+
+static void test_arena()
+{
+	std::size_t escaped = cs::var_arena::escaped(), pinned = cs::var_arena::pinned();
+	cs::var kept;
+	{
+		cs::var_arena outer;
+		cs::var a = make_array();
+		{
+			cs::var_arena inner;
+			check(cs::var_arena::current() == &inner, "nested arenas become the innermost one");
+			{
+				// Holders too large for the block of a proxy are taken from the arena too
+				cs::var b = cs::var::make<large_value>();
+				check(cs::var_arena::contains(&b.const_val<large_value>()), "large holders are allocated from arenas");
+				kept = b;
+			}
+			{
+				cs::var c = make_array();
+				c.val<cs::array>().push_back(cs::numeric(3));
+				check(size_of(a) == 2 && size_of(c) == 3, "variables of nested arenas are independent");
+			}
+			// The proxy and the holder of the kept value escape
+			check(inner.close() == 2, "closing an arena counts escaped blocks");
+		}
+		check(cs::var_arena::current() == &outer, "closing an arena restores the enclosing one");
+		check(cs::var_arena::pinned() == pinned + 1 && cs::var_arena::escaped() == escaped + 2, "escaped blocks and the slabs they pin are reported");
+	}
+	check(cs::var_arena::current() == nullptr, "closing all arenas leaves none");
+	kept.val<large_value>().x = 1;
+	check(kept.const_val<large_value>().x == 1, "escaped values stay usable");
+	kept = cs::var::make<large_value>();
+	check(!cs::var_arena::contains(&kept.const_val<large_value>()), "large holders outside of arenas come from pools");
+	check(cs::var_arena::pinned() == pinned, "releasing escaped values releases their slab");
+}
+
+static std::uintptr_t slab_of(const void *ptr)
+{
+	return reinterpret_cast<std::uintptr_t>(ptr) & ~std::uintptr_t(cs::slab_heap::slab_size - 1);
+}
+
+// Occupies the last size class, which no variable of the tests uses
+struct slab_value {
+	char data[cs::slab_heap::max_size - 8];
+};
+
+static void test_slab_heap()
+{
+	cs::slab_heap heap;
+	// Sizes are rounded up to their class, each class has slabs of its own
+	void *a = heap.allocate(1);
+	void *b = heap.allocate(cs::slab_heap::granularity);
+	void *c = heap.allocate(cs::slab_heap::granularity + 1);
+	void *d = heap.allocate(2 * cs::slab_heap::granularity);
+	check(static_cast<char *>(b) - static_cast<char *>(a) == cs::slab_heap::granularity, "blocks of the smallest class are granularity apart");
+	check(static_cast<char *>(d) - static_cast<char *>(c) == 2 * cs::slab_heap::granularity, "blocks are rounded up to their class");
+	check(slab_of(a) == slab_of(b) && slab_of(a) != slab_of(c), "size classes do not share slabs");
+	check(heap.size() == 2, "one slab for each size class in use");
+
+	// A class grows past one slab once it is full
+	std::vector<void *> blocks{c, d};
+	std::size_t per_slab = cs::slab_heap::slab_size / (2 * cs::slab_heap::granularity);
+	while (blocks.size() <= per_slab)
+		blocks.push_back(heap.allocate(2 * cs::slab_heap::granularity));
+	check(heap.size() == 3, "full slabs are followed by a new one");
+	check(slab_of(blocks.front()) != slab_of(blocks.back()), "blocks beyond one slab come from the next slab");
+
+	// Empty slabs but one spare of each class are released to the heap, trim returns all of them
+	for (void *block: blocks)
+		cs::slab_heap::deallocate(block);
+	check(heap.size() == 2, "a class keeps one empty slab");
+	cs::slab_heap::deallocate(a);
+	cs::slab_heap::deallocate(b);
+	check(heap.size() == 2, "spare slabs stay with their class");
+	check(heap.trim() == 3, "trim returns spare and cached slabs");
+	check(heap.size() == 0, "trimmed heaps hold no slabs");
+
+	// Single objects of slab_provider come from the heap of current process
+	cs::slab_provider<slab_value> provider;
+	std::size_t acquired = cs::slab_heap::current()->acquired();
+	std::vector<slab_value *> values;
+	for (std::size_t i = 0; i <= cs::slab_heap::slab_size / sizeof(slab_value); ++i)
+		values.push_back(provider.allocate(1));
+	check(cs::slab_heap::current()->acquired() >= acquired + 2, "slab providers allocate from the process heap");
+	check(slab_of(values.front()) != slab_of(values.back()), "slab providers grow past one slab");
+	for (slab_value *value: values)
+		provider.deallocate(value, 1);
+}
+
+// Free blocks in the depot of holders of large_value
+static std::size_t large_value_depot_size()
+{
+	std::size_t block_size = (sizeof(large_value) + cs::slab_heap::granularity - 1) / cs::slab_heap::granularity * cs::slab_heap::granularity;
+	for (auto &stats: cs::pool_allocator::current()->statistics())
+		if (stats.block_size == block_size && stats.magazine_size == cs_impl::default_allocate_buffer_size)
+			return stats.size;
+	return 0;
+}
+
+static void test_magazines()
+{
+	// Blocks freed by another thread join the magazine of that thread
+	std::vector<cs::var> vars;
+	std::thread producer([&vars] {
+		for (std::size_t i = 0; i < 16; ++i)
+			vars.push_back(cs::var::make<large_value>());
+	});
+	producer.join();
+	const void *last = &vars.back().const_val<large_value>();
+	vars.clear();
+	cs::var reused = cs::var::make<large_value>();
+	check(&reused.const_val<large_value>() == last, "blocks freed by another thread are reused by the freeing thread");
+
+	// Magazines of exiting threads are returned to the depot
+	cs::pool_allocator::current()->release_memory();
+	check(large_value_depot_size() == 0, "released depots are empty");
+	std::thread worker([] {
+		std::vector<cs::var> local;
+		for (std::size_t i = 0; i < 40; ++i)
+			local.push_back(cs::var::make<large_value>());
+	});
+	worker.join();
+	check(large_value_depot_size() >= 40, "exiting threads flush their magazine to the depot");
+}
+
+static std::size_t depot_releases = 0;
+
+static void count_release(void *)
+{
+	++depot_releases;
+}
+
+static cs::pool_statistics depot_statistics(cs::block_depot &depot)
+{
+	cs::pool_statistics stats;
+	depot.statistics(stats);
+	return stats;
+}
+
+static void test_adaptive_depots()
+{
+	// Capacity doubles on misses up to the upper bound
+	char storage[32];
+	void *blocks[32];
+	for (std::size_t i = 0; i < 32; ++i)
+		blocks[i] = storage + i;
+	depot_releases = 0;
+	{
+		cs::block_depot depot(4, 4, 32, &count_release);
+		std::size_t capacities[] = {8, 16, 32, 32};
+		for (std::size_t expected: capacities) {
+			check(depot.get(blocks, 4, 0) == 0, "empty depots serve no blocks");
+			check(depot_statistics(depot).capacity == expected, "misses grow depots within their bounds");
+		}
+		check(depot_statistics(depot).misses == 4, "misses are counted");
+
+		// Capacity halves after a window of exchanges without misses that left half of it unused
+		depot.put(blocks, 32, 0);
+		while (depot_statistics(depot).exchanges < 128)
+			depot.put(blocks, 0, 0);
+		cs::pool_statistics stats = depot_statistics(depot);
+		check(stats.capacity == 16 && stats.size == 16 && depot_releases == 16, "idle depots shrink and release blocks");
+		check(stats.high_water == 32, "depots keep their high water mark");
+		check(depot.trim() == 16 && depot_statistics(depot).capacity == 4, "trimmed depots return to their lower bound");
+	}
+
+	// Depots created after loading a profile begin at its high water mark
+	cs::pool_allocator *pools = cs::pool_allocator::current();
+	std::istringstream profile("# block_size magazine_size high_water\n48 7 20\n");
+	pools->load_profile(profile);
+	std::shared_ptr<cs::block_depot> depot = pools->depot(48, 7);
+	check(depot->size() == 20 && depot_statistics(*depot).capacity == 20, "profiles size new depots");
+	std::ostringstream saved;
+	pools->save_profile(saved);
+	check(saved.str().find("\n48 7 20\n") != std::string::npos, "saved profiles hold high water marks");
+	std::istringstream malformed("48 seven 20\n");
+	bool thrown = false;
+	try {
+		pools->load_profile(malformed);
+	}
+	catch (const cs::runtime_error &) {
+		thrown = true;
+	}
+	check(thrown, "malformed profiles are rejected");
+	std::istringstream empty;
+	pools->load_profile(empty);
+	depot->trim();
+}
+
+static void test_idle_release()
+{
+	// A burst leaves free blocks in the depot, live values stay in their slabs
+	std::vector<cs::var> live;
+	for (int i = 0; i < 16; ++i) {
+		live.push_back(cs::var::make<large_value>());
+		live.back().val<large_value>().x = i;
+	}
+	std::thread burst([] {
+		std::vector<cs::var> temp;
+		for (std::size_t i = 0; i < 1024; ++i)
+			temp.push_back(cs::var::make<large_value>());
+	});
+	burst.join();
+	check(large_value_depot_size() > 0, "bursts leave free blocks in the depot");
+
+	cs::pool_allocator *pools = cs::pool_allocator::current();
+	cs::idle_release idle;
+	idle.set_period(std::chrono::milliseconds(1));
+	check(idle.poll(pools) == 0, "pools that were just used are not released");
+	std::this_thread::sleep_for(std::chrono::milliseconds(5));
+	check(idle.poll(pools) > 0, "idle pools return slabs to the system");
+	check(large_value_depot_size() == 0, "idle release empties the depots");
+	check(idle.poll(pools) == 0, "idle pools are released once");
+	bool kept = true;
+	for (int i = 0; i < 16; ++i)
+		kept = kept && live[i].const_val<large_value>().x == i;
+	check(kept, "idle release keeps live values");
+
+	// Polling of the process context releases idle pools as well
+	std::thread again([] {
+		std::vector<cs::var> temp;
+		for (std::size_t i = 0; i < 1024; ++i)
+			temp.push_back(cs::var::make<large_value>());
+	});
+	again.join();
+	cs::current_process->pool_release.set_period(std::chrono::milliseconds(1));
+	for (int i = 0; i < 1024; ++i)
+		cs::current_process->poll_event();
+	std::this_thread::sleep_for(std::chrono::milliseconds(5));
+	for (int i = 0; i < 1024; ++i)
+		cs::current_process->poll_event();
+	check(large_value_depot_size() == 0, "polling releases idle pools");
+	cs::current_process->pool_release.set_period(std::chrono::steady_clock::duration::zero());
+}
+
+#ifdef COVSCRIPT_VAR_DEFERRED_RELEASE
+static void test_deferred_release()
+{
+	cs::release_queue &queue = cs::current_process->var_release;
+	queue.enable(true);
+	{
+		cs::var outer = cs::var::make<cs::array>();
+		for (int i = 0; i < 3; ++i)
+			outer.val<cs::array>().push_back(make_array());
+	}
+	check(queue.size() == 1, "released containers are queued");
+	check(queue.drain(1) == 1, "drain releases at most budget containers");
+	check(queue.size() == 3, "nested containers are queued again");
+	queue.set_budget(2);
+	cs::current_process->poll_event();
+	check(queue.size() == 1, "polling drains the budget");
+	queue.set_budget(64);
+	{
+		cs::var temp = make_array();
+	}
+	check(queue.size() == 2, "containers are queued while draining is pending");
+	queue.enable(false);
+	check(queue.size() == 0, "disabling the queue drains it");
+	{
+		cs::var temp = make_array();
+	}
+	check(queue.size() == 0, "disabled queues release at once");
+}
+#endif
+
+#ifdef COVSCRIPT_VAR_CYCLE_COLLECTOR
+static void make_cycle()
+{
+	cs::var a = cs::var::make<cs::array>(), b = cs::var::make<cs::array>();
+	a.val<cs::array>().push_back(b);
+	b.val<cs::array>().push_back(a);
+}
+
+static void test_cycle_collector()
+{
+	cs::cycle_collector &cycles = cs::current_process->var_cycles;
+	cycles.collect();
+	make_cycle();
+	cs::var kept = cs::var::make<cs::array>();
+	kept.val<cs::array>().push_back(kept);
+	check(cycles.collect() == 2, "unreachable cycles are reclaimed");
+	{
+		cs::var self = cs::var::make<cs::array>();
+		self.val<cs::array>().push_back(self);
+	}
+	check(cycles.collect() == 1, "unreachable containers referring to themselves are reclaimed");
+	check(kept.const_val<cs::array>().size() == 1, "cycles referenced from elsewhere are kept");
+
+	// Containers are suspected and forgotten by several threads at once
+	std::vector<std::thread> workers;
+	for (int i = 0; i < 4; ++i)
+		workers.emplace_back([] {
+			cs::thread_guard guard;
+			for (int n = 0; n < 1000; ++n) {
+				make_cycle();
+				cs::var temp = cs::var::make<cs::array>();
+			}
+		});
+	for (auto &worker: workers)
+		worker.join();
+	check(cycles.collect() == 8000, "cycles left by other threads are reclaimed");
+	check(cycles.suspects() == 0, "collection empties the buffer");
+	kept.val<cs::array>().clear();
+}
+#endif
 
 int main(int argc, const char **args)
 {
 	if (argc != 2)
 		return -1;
+	test_copy_on_write();
+	test_borrowing();
+	test_raw_swap();
+	test_moved_payloads();
+	test_immediate_values();
+	test_hash_cache();
+	test_symbol_lookup();
+	test_type_ids();
+	test_memory_budget();
+	test_arena();
+	test_slab_heap();
+	test_magazines();
+	test_adaptive_depots();
+	test_idle_release();
+#ifdef COVSCRIPT_VAR_DEFERRED_RELEASE
+	test_deferred_release();
+#endif
+#ifdef COVSCRIPT_VAR_CYCLE_COLLECTOR
+	test_cycle_collector();
+#endif
+	if (failures != 0)
+		return -1;
 	cs::extension dll(args[1]);
 	cs::function_invoker<void(std::string)> func1(dll.get_var("print"));
 	func1("Hello");
 	cs::var func2 = dll.get_var("print");
 	cs::invoke(func2, "Hello");
+
+	// Extensions allocate from the pools of the host
+	check(cs::invoke(dll.get_var("pool_allocator")).const_val<cs::pool_allocator *>() == cs::pool_allocator::current(), "extensions share the pool allocator of the host");
+	check(cs::invoke(dll.get_var("slab_heap")).const_val<cs::slab_heap *>() == cs::slab_heap::current(), "extensions share the slab heap of the host");
+	std::size_t acquired = cs::slab_heap::current()->acquired();
+	{
+		std::vector<cs::var> arrays;
+		cs::var make = dll.get_var("make_array");
+		for (std::size_t i = 0; i < 4096; ++i)
+			arrays.push_back(cs::invoke(make));
+		check(size_of(arrays.back()) == 2, "values made by extensions are usable by the host");
+	}
+	check(cs::slab_heap::current()->acquired() > acquired, "values made by extensions come from the slab heap of the host");
+	if (failures != 0)
+		return -1;
 	return 0;
 }